@@ -5,6 +5,7 @@
 #include <iostream>
 #include <cassert>
 #include <cmath>
+#include <algorithm>
 
 // Duty cycle waveforms
 const uint8_t APU::DUTY_WAVEFORMS[4][8] = {
@@ -38,40 +39,59 @@ const uint16_t NOISE_PERIOD_TABLE[16] = {
 };
 
 
-APU::APU() {
-    pulse1_duty = 0;
-    pulse1_sweep = 0;
-    pulse1_timer_low = 0;
-    pulse1_length = 0;
-    pulse1_timer = 0;
-    pulse1_timer_counter = 0.0f;
-    pulse1_duty_pos = 0;
-    pulse1_volume = 0;
-    pulse1_enabled = false;
+// NTSC DMC timer periods in CPU cycles (indexed by bits 0-3 of $4010)
+const uint16_t DMC_RATE_TABLE[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214,
+    190, 160, 142, 128, 106, 84, 72, 54
+};
 
-    envelope_loop = false;
-    envelope_constant = false;
-    envelope_period = 0;
-    envelope_counter = 0;
-    envelope_volume = 0;
-    envelope_start = false;
 
-    length_counter = 0;
-    length_counter_halt = false;
+static constexpr std::array<float, 31> buildPulseTable() {
+    std::array<float, 31> table{};
+    for (int n = 1; n < 31; n++) {
+        table[n] = static_cast<float>(95.52 / (8128.0 / n + 100));
+    }
+    return table;
+}
+
+static constexpr std::array<float, 203> buildTndTable() {
+    std::array<float, 203> table{};
+    for (int n = 1; n < 203; n++) {
+        table[n] = static_cast<float>(163.67 / (24329.0 / n + 100));
+    }
+    return table;
+}
+
+const std::array<float, 31> APU::PULSE_TABLE = buildPulseTable();
+const std::array<float, 203> APU::TND_TABLE = buildTndTable();
+
+
+// Output samples one blip buffer frame has room for, and how long a frame may run before
+// the APU ends it itself (when nothing calls endFrame, e.g. a headless run)
+constexpr int BLIP_CAPACITY = APU::SAMPLE_RATE / 4;
+constexpr uint32_t MAX_FRAME_TICKS = static_cast<uint32_t>(APU::CLOCK_RATE / 10);
+
+
+APU::APU() : blip(CLOCK_RATE, SAMPLE_RATE, BLIP_CAPACITY) {
+    reset();
 
     SDL_Init(SDL_INIT_AUDIO);
     SDL_AudioSpec want;
     SDL_zero(want);
-    want.freq = 44100;
+    want.freq = SAMPLE_RATE;
     want.format = AUDIO_F32SYS;
     want.channels = 1;
-    want.samples = 1024;
+    want.samples = 512;     // Latency is set by how full queueAudio keeps the ring
 
     want.callback = [](void* userdata, Uint8* stream, int len) {
         APU* apu = static_cast<APU*>(userdata);
         float* fstream = reinterpret_cast<float*>(stream);
-        int samples = len / sizeof(float);
-        apu->generateSamples(fstream, samples);
+        int count = len / sizeof(float);
+        int got = static_cast<int>(apu->audioRing.read(fstream, count));
+        if (got > 0) {
+            apu->lastPlayed = fstream[got - 1];
+        }
+        std::fill(fstream + got, fstream + count, apu->lastPlayed);
     };
     want.userdata = this;
 
@@ -80,7 +100,8 @@ APU::APU() {
         printf("Failed to open audio: %s\n", SDL_GetError());
         return;
     }
-    SDL_PauseAudioDevice(audioDevice, 0);
+    sampleRate = audioSpec.freq;
+    blip.setRates(CLOCK_RATE, sampleRate);
 }
 
 APU::~APU() {
@@ -90,6 +111,7 @@ APU::~APU() {
 
 
 void APU::writeRegister(uint16_t address, uint8_t value) {
+    synthesize(clockCounter);
     // if (address >= 0x4000 && address <= 0x4007) {
     //     std::cout << "[APU] Write $" << std::hex << address << " = " << std::dec << (int)value << "\n";
     // }
@@ -215,25 +237,38 @@ void APU::writeRegister(uint16_t address, uint8_t value) {
             noise_enabled = true;
             break;
 
-        // case 0x4010: // Control (IRQ, loop, frequency index)
-        //     dmc_control = value;
-        //     dmc_timer_period = NOISE_PERIOD_TABLE[value & 0x0F]; // Reuse noise periods for now
-        //     break;
-        //
-        // case 0x4011: // DAC direct output value (7 bits)
-        //     dmc_output_level = value & 0x7F;
-        //     break;
-        //
-        // case 0x4012: // Sample address (start)
-        //     dmc_sample_address = value;
-        //     dmc_current_address = 0xC000 + (value * 64);
-        //     break;
-        //
-        // case 0x4013: // Sample length
-        //     dmc_sample_length = value;
-        //     dmc_bytes_remaining = (value * 16) + 1;
-        //     break;
+        case 0x4010: // DMC IRQ enable, loop, rate index
+            dmc_control = value;
+            dmc_timer_period = DMC_RATE_TABLE[value & 0x0F];   // From the next timer reload on
+            if ((value & 0x80) == 0) {
+                dmc_irq_flag = false;
+            }
+            break;
+
+        case 0x4011: // DMC output level
+            dmc_output_level = value & 0x7F;
+            break;
+
+        case 0x4012: // DMC sample address, $C000 + value * 64
+            dmc_sample_address = value;
+            break;
+
+        case 0x4013: // DMC sample length, value * 16 + 1 bytes
+            dmc_sample_length = value;
+            break;
+
+        case 0x4015: // Channel enables, only the DMC's so far
+            dmc_irq_flag = false;
+            if ((value & 0x10) == 0) {
+                dmc_bytes_remaining = 0;
+            } else if (dmc_bytes_remaining == 0) {
+                restartDmcSample();
+                fetchDmcSample();
+            }
+            break;
     }
+    updateDmcFetch();
+    updateOutput();
 }
 
 uint8_t APU::readRegister(uint16_t address) {
@@ -244,9 +279,8 @@ uint8_t APU::readRegister(uint16_t address) {
             if (length_counter2 > 0)          status |= 0x02;
             if (triangle_length_counter > 0)  status |= 0x04;
             if (noise_length_counter > 0)     status |= 0x08;
-            // if (dmc_irq_flag)                 status |= 0x80;  // Bit 7 = DMC IRQ
-
-            // dmc_irq_flag = false;  // Clear IRQ on read
+            if (dmc_bytes_remaining > 0)      status |= 0x10;
+            if (dmc_irq_flag)                 status |= 0x80;
             return status;
     }
 
@@ -258,174 +292,163 @@ uint8_t APU::readRegister(uint16_t address) {
     }
 }
 
-void APU::generateSamples(float* stream, int length) {
-    if ((pulse1_enabled == false || pulse1_timer == 0) &&
-        (pulse2_enabled == false || pulse2_timer == 0) &&
-        (triangle_enabled == false || triangle_timer == 0 || triangle_length_counter == 0 || triangle_linear_counter == 0) &&
-        (noise_enabled == false || noise_timer == 0 || noise_length_counter == 0)) {
-
-        for (int i = 0; i < length; i++) {
-            stream[i] = 0.0f;
+// Each channel counts down the ticks to its next step; jump straight to whichever comes
+// first, since the output can only change there
+void APU::synthesize(uint32_t masterCycle) {
+    while (audioClock != masterCycle) {
+        // Pulse timers under 8 are silenced by the sweep unit, a triangle under 2 is ultrasonic
+        bool pulse1On = pulse1_enabled && pulse1_timer >= 8;
+        bool pulse2On = pulse2_enabled && pulse2_timer >= 8;
+        bool triangleOn = triangle_enabled && triangle_timer >= 2 &&
+                          triangle_length_counter > 0 && triangle_linear_counter > 0;
+        bool noiseOn = noise_enabled && noise_length_counter > 0;
+        // With nothing to play the DMC timer only keeps its phase, worked out below
+        bool dmcOn = !dmc_silence || !dmc_sample_buffer_empty;
+
+        if (audioClock - frameStart == MAX_FRAME_TICKS) {
+            finishFrame();
         }
-        return;
-    }
-
-    float cpu_cycles_per_sample = 1789773.0f / audioSpec.freq;
-    float timer_period1 = pulse1_timer + 1;
-    float timer_period2 = pulse2_timer + 1;
-
-    // Update noise timer period from mode value
-    uint8_t noise_period_index = noise_mode_period & 0x0F;
-    noise_timer = NOISE_PERIOD_TABLE[noise_period_index];
-
-    if (noise_lfsr == 0) {
-        // std::cout << "[Noise] LFSR got stuck! Resetting to 1\n";
-        noise_lfsr = 1;
-    }
-
-    for (int i = 0; i < length; i++) {
-        // --- Pulse 1 ---
-        float sample1 = 0.0f;
-        if (pulse1_enabled && timer_period1 > 0) {
-            pulse1_timer_counter -= cpu_cycles_per_sample;
-            if (pulse1_timer_counter <= 0) {
-                pulse1_duty_pos = (pulse1_duty_pos + 1) % 8;
-                pulse1_timer_counter += timer_period1;
-            }
-
-            uint8_t duty1 = (pulse1_duty >> 6) & 0x03;
-            sample1 = DUTY_WAVEFORMS[duty1][pulse1_duty_pos] ? (pulse1_volume / 15.0f) : 0.0f;
+        uint32_t step = std::min(masterCycle - audioClock, MAX_FRAME_TICKS - (audioClock - frameStart));
+        if (pulse1On)   step = std::min(step, pulse1_timer_counter);
+        if (pulse2On)   step = std::min(step, pulse2_timer_counter);
+        if (triangleOn) step = std::min(step, triangle_timer_counter);
+        if (noiseOn)    step = std::min(step, noise_timer_counter);
+        if (dmcOn)      step = std::min(step, dmc_timer_counter);
+        audioClock += step;
+
+        // A counter already at 0 is a channel that just started: it steps right away
+        bool changed = false;
+        if (pulse1On && (pulse1_timer_counter -= step) == 0) {
+            pulse1_duty_pos = (pulse1_duty_pos + 1) % 8;
+            pulse1_timer_counter = (pulse1_timer + 1) * 6;      // Pulse timers run at half the CPU clock
+            changed = true;
         }
-
-        // --- Pulse 2 ---
-        float sample2 = 0.0f;
-        if (pulse2_enabled && timer_period2 > 0) {
-            pulse2_timer_counter -= cpu_cycles_per_sample;
-            if (pulse2_timer_counter <= 0) {
-                pulse2_duty_pos = (pulse2_duty_pos + 1) % 8;
-                pulse2_timer_counter += timer_period2;
+        if (pulse2On && (pulse2_timer_counter -= step) == 0) {
+            pulse2_duty_pos = (pulse2_duty_pos + 1) % 8;
+            pulse2_timer_counter = (pulse2_timer + 1) * 6;
+            changed = true;
+        }
+        if (triangleOn && (triangle_timer_counter -= step) == 0) {
+            triangle_wave_pos = (triangle_wave_pos + 1) % 32;
+            triangle_timer_counter = (triangle_timer + 1) * 3;
+            changed = true;
+        }
+        if (noiseOn && (noise_timer_counter -= step) == 0) {
+            bool mode = (noise_mode_period & 0x80) != 0;
+            uint8_t bit0 = noise_lfsr & 0x1;
+            uint8_t tap = mode ? ((noise_lfsr >> 6) & 0x1) : ((noise_lfsr >> 1) & 0x1);
+            uint8_t feedback = bit0 ^ tap;
+
+            noise_lfsr >>= 1;
+            noise_lfsr |= (feedback << 14);
+            noise_timer = NOISE_PERIOD_TABLE[noise_mode_period & 0x0F];
+            noise_timer_counter = noise_timer * 3;
+            changed = true;
+        }
+        if (dmcOn && (dmc_timer_counter -= step) == 0) {
+            dmc_timer_counter = dmc_timer_period * 3;
+            clockDmcOutput();
+            changed = true;
+        } else if (!dmcOn) {
+            uint32_t period = dmc_timer_period * 3;
+            if (step >= dmc_timer_counter) {
+                uint32_t past = step - dmc_timer_counter;
+                uint32_t clocks = 1 + past / period;
+                dmc_timer_counter = period - past % period;
+                dmc_bits_remaining = (dmc_bits_remaining - 1 + 8 - clocks % 8) % 8 + 1;
+            } else {
+                dmc_timer_counter -= step;
             }
-
-            uint8_t duty2 = (pulse2_duty >> 6) & 0x03;
-            sample2 = DUTY_WAVEFORMS[duty2][pulse2_duty_pos] ? (pulse2_volume / 15.0f) : 0.0f;
         }
+        if (changed) {
+            updateOutput();
+        }
+    }
+}
 
-        // --- Triangle ---
-        float triangle_sample = 0.0f;
-        if (triangle_enabled && triangle_timer > 0 &&
-            triangle_length_counter > 0 && triangle_linear_counter > 0) {
-
-            triangle_timer_counter -= cpu_cycles_per_sample;
-            if (triangle_timer_counter <= 0) {
-                triangle_wave_pos = (triangle_wave_pos + 1) % 32;
-                triangle_timer_counter += (triangle_timer + 1);
-            }
+void APU::updateOutput() {
+    // --- Pulse ---
+    uint8_t sample1 = 0;
+    if (pulse1_enabled && pulse1_timer >= 8) {
+        uint8_t duty1 = (pulse1_duty >> 6) & 0x03;
+        sample1 = DUTY_WAVEFORMS[duty1][pulse1_duty_pos] ? pulse1_volume : 0;
+    }
+    uint8_t sample2 = 0;
+    if (pulse2_enabled && pulse2_timer >= 8) {
+        uint8_t duty2 = (pulse2_duty >> 6) & 0x03;
+        sample2 = DUTY_WAVEFORMS[duty2][pulse2_duty_pos] ? pulse2_volume : 0;
+    }
 
-            triangle_sample = TRIANGLE_WAVE[triangle_wave_pos] / 15.0f;
-        }
+    // --- Triangle ---
+    uint8_t triangle_sample = 0;
+    if (triangle_enabled && triangle_timer >= 2 &&
+        triangle_length_counter > 0 && triangle_linear_counter > 0) {
+        triangle_sample = TRIANGLE_WAVE[triangle_wave_pos];
+    }
 
-        // --- Noise ---
-        float noise_sample = 0.0f;
-        if (noise_enabled && noise_timer > 0 && noise_length_counter > 0) {
-            noise_timer_counter -= cpu_cycles_per_sample;
-            if (noise_timer_counter <= 0.0f) {
-                bool mode = (noise_mode_period & 0x80) != 0;
-                uint8_t bit0 = noise_lfsr & 0x1;
-                uint8_t tap = mode ? ((noise_lfsr >> 6) & 0x1) : ((noise_lfsr >> 1) & 0x1);
-                uint8_t feedback = bit0 ^ tap;
-
-                noise_lfsr >>= 1;
-                noise_lfsr |= (feedback << 14);
-                noise_timer_counter += noise_timer;
-            }
+    // --- Noise ---
+    uint8_t noise_sample = 0;
+    if (noise_enabled && noise_length_counter > 0) {
+        noise_sample = (~noise_lfsr & 0x1) ? noise_volume : 0;
+    }
 
-            noise_sample = (~noise_lfsr & 0x1) ? (noise_volume / 15.0f) : 0.0f;
-        }
+    // --- Mix ---
+    float output = (PULSE_TABLE[sample1 + sample2] +
+                    TND_TABLE[3 * triangle_sample + 2 * noise_sample + dmc_output_level]) * 0.5f;
+    if (output != lastOutput) {
+        blip.addDelta(audioClock - frameStart, output - lastOutput);
+        lastOutput = output;
+    }
+}
 
-        // // --- DMC ---
-        // float dmc_sample = 0.0f;
-        //
-        // if (dmc_enabled && dmc_timer_period > 0) {
-        //     if (dmc_bits_remaining > 8) {
-        //         std::cout << "[DMC] bits_remaining overflow! = " << (int)dmc_bits_remaining << " → clamping to 8\n";
-        //         dmc_bits_remaining = 8;
-        //     }
-        //
-        //     dmc_timer_counter -= cpu_cycles_per_sample;
-        //     if (dmc_timer_counter <= 0.0f) {
-        //         dmc_timer_counter += dmc_timer_period;
-        //
-        //         if (dmc_bits_remaining == 0) {
-        //             if (dmc_bytes_remaining > 0) {
-        //                 if (bus) {
-        //                     dmc_sample_buffer = bus->read(dmc_current_address);
-        //                     std::cout << "[DMC] Sample byte read: $" << std::hex << (int)dmc_sample_buffer << std::dec << "\n";
-        //                 } else {
-        //                     dmc_sample_buffer = 0x00;
-        //                 }
-        //
-        //                 dmc_shift_register = dmc_sample_buffer;
-        //                 dmc_bits_remaining = 8;
-        //
-        //                 // Clamp just in case
-        //                 if (dmc_bits_remaining > 8) {
-        //                     dmc_bits_remaining = 8;
-        //                 }
-        //
-        //                 dmc_current_address = (dmc_current_address + 1) & 0xFFFF;
-        //                 if (dmc_current_address < 0x8000) {
-        //                     dmc_current_address = 0x8000;
-        //                 }
-        //
-        //                 dmc_bytes_remaining--;
-        //                 if (dmc_bytes_remaining == 0 && (dmc_control & 0x40)) {
-        //                     dmc_bytes_remaining = (dmc_sample_length * 16) + 1;
-        //                     dmc_current_address = 0xC000 + (dmc_sample_address * 64);
-        //                 } else if (dmc_bytes_remaining == 0) {
-        //                     dmc_enabled = false;
-        //                 }
-        //             }
-        //         }
-        //
-        //         // Process one bit from the shift register (using clamped range)
-        //         uint8_t bit = dmc_shift_register & 0x01;
-        //         uint8_t max_level = 15;
-        //
-        //         if (bit && dmc_output_level < max_level) {
-        //             dmc_output_level++;
-        //         } else if (!bit && dmc_output_level > 0) {
-        //             dmc_output_level--;
-        //         }
-        //
-        //         dmc_shift_register >>= 1;
-        //         dmc_bits_remaining--;
-        //     }
-        //
-        //     dmc_sample = dmc_output_level / 15.0f;
-        // }
-
-        // --- Mix ---
-        float pulse_out = 0.0f;
-        if (sample1 != 0.0f || sample2 != 0.0f) {
-            float pulse_mix = 95.88f / ((8128.0f / (sample1 * 15.0f + sample2 * 15.0f)) + 100);
-            pulse_out = pulse_mix;
-        }
+void APU::endFrame() {
+    synthesize(clockCounter);
+    finishFrame();
+}
 
-        float tnd_mix = 0.0f;
-        float tnd_input = (triangle_sample * 15.0f) + (noise_sample * 15.0f);  // + (dmc_sample * 15.0f);
-        if (tnd_input != 0.0f) {
-            tnd_mix = 159.79f / ((1.0f / tnd_input) + 100);
-        }
+void APU::finishFrame() {
+    blip.endFrame(audioClock - frameStart);
+    frameStart = audioClock;
 
-        stream[i] = (pulse_out + tnd_mix) * 0.5f;
+    int count = blip.samplesAvailable();
+    // Nobody is taking them: drop the backlog rather than grow without end
+    if (samples.size() + count > static_cast<size_t>(sampleRate)) {
+        samples.clear();
     }
+    size_t oldSize = samples.size();
+    samples.resize(oldSize + count);
+    blip.readSamples(samples.data() + oldSize, count);
 }
 
+void APU::queueAudio() {
+    if (audioDevice == 0) {
+        return;
+    }
+    audioRing.write(samples.data(), samples.size());
+    samples.clear();
+    if (!audioStarted && audioRing.fill() >= AudioRing::TARGET_FILL) {
+        SDL_PauseAudioDevice(audioDevice, 0);
+        audioStarted = true;
+    }
+    // The next frame's samples come out a fraction of a percent faster or slower, too little
+    // to hear as pitch but enough to hold the ring at its target
+    blip.setRates(CLOCK_RATE, sampleRate * audioRing.rateRatio());
+}
 
 
 void APU::clock() {
+    clockCounter++;
     frame_sequencer_counter++;
 
+    if (dmcFetchPending && clockCounter == dmcFetchAt) {
+        synthesize(clockCounter);   // Fetches the byte, stalling the CPU this tick
+    }
+    if (frame_sequencer_counter != 7457 && frame_sequencer_counter != 14913 &&
+        frame_sequencer_counter != 22371 && frame_sequencer_counter != 29828) {
+        return;
+    }
+    synthesize(clockCounter);   // The step changes volumes and lengths from this tick on
+
     if (frame_sequencer_counter == 7457) {
         clockEnvelopeAndLength();
     } else if (frame_sequencer_counter == 14913) {
@@ -438,6 +461,95 @@ void APU::clock() {
         clockSweepUnits();
         frame_sequencer_counter = 0;
     }
+    updateOutput();
+}
+
+uint32_t APU::ticksUntilFrameStep() const {
+    int nextStep = frame_sequencer_counter < 7457  ? 7457 :
+                   frame_sequencer_counter < 14913 ? 14913 :
+                   frame_sequencer_counter < 22371 ? 22371 : 29828;
+    return nextStep - frame_sequencer_counter;
+}
+
+uint32_t APU::ticksUntilEvent() const {
+    uint32_t untilStep = ticksUntilFrameStep();
+    return dmcFetchPending ? std::min(untilStep, dmcFetchAt - clockCounter) : untilStep;
+}
+
+// Nothing happens between frame sequencer steps and DMC fetches, so jump from one to the next
+void APU::runUntil(uint32_t masterCycle) {
+    while (clockCounter != masterCycle) {
+        uint32_t untilStep = ticksUntilEvent();
+        uint32_t remaining = masterCycle - clockCounter;
+        if (remaining < untilStep) {
+            frame_sequencer_counter += remaining;
+            clockCounter = masterCycle;
+            return;
+        }
+        frame_sequencer_counter += untilStep - 1;
+        clockCounter += untilStep - 1;
+        clock();
+    }
+}
+
+
+void APU::clockDmcOutput() {
+    if (!dmc_silence) {
+        if (dmc_shift_register & 0x01) {
+            if (dmc_output_level <= 125) {
+                dmc_output_level += 2;
+            }
+        } else if (dmc_output_level >= 2) {
+            dmc_output_level -= 2;
+        }
+        dmc_shift_register >>= 1;
+    }
+
+    if (--dmc_bits_remaining == 0) {
+        dmc_bits_remaining = 8;
+        dmc_silence = dmc_sample_buffer_empty;
+        if (!dmc_sample_buffer_empty) {
+            dmc_shift_register = dmc_sample_buffer;
+            dmc_sample_buffer_empty = true;
+            fetchDmcSample();
+        }
+    }
+}
+
+void APU::fetchDmcSample() {
+    if (!dmc_sample_buffer_empty || dmc_bytes_remaining == 0) {
+        return;
+    }
+    if (bus) {
+        bus->stallCpu(DMC_STALL_CYCLES);
+        dmc_sample_buffer = bus->read(dmc_current_address);
+    } else {
+        dmc_sample_buffer = 0x00;
+    }
+    dmc_sample_buffer_empty = false;
+    dmc_current_address = dmc_current_address == 0xFFFF ? 0x8000 : dmc_current_address + 1;
+
+    if (--dmc_bytes_remaining == 0) {
+        if (dmc_control & 0x40) {
+            restartDmcSample();
+        } else if (dmc_control & 0x80) {
+            dmc_irq_flag = true;
+        }
+    }
+    updateDmcFetch();
+}
+
+void APU::restartDmcSample() {
+    dmc_current_address = 0xC000 + dmc_sample_address * 64;
+    dmc_bytes_remaining = dmc_sample_length * 16 + 1;
+}
+
+// The next fetch comes when the output unit takes the byte now in the buffer, at the end of
+// its current 8 bit cycle. A new rate applies from the next timer reload, so it counts for
+// every timer period but the one under way.
+void APU::updateDmcFetch() {
+    dmcFetchPending = !dmc_sample_buffer_empty && dmc_bytes_remaining > 0;
+    dmcFetchAt = audioClock + dmc_timer_counter + (dmc_bits_remaining - 1) * dmc_timer_period * 3;
 }
 
 
@@ -599,13 +711,20 @@ void APU::clockSweepUnits() {
 
 
 void APU::reset() {
+    clockCounter = 0;
+    audioClock = 0;
+    frameStart = 0;
+    lastOutput = 0.0f;
+    blip.clear();
+    samples.clear();
+
     // Reset Pulse 1 state
     pulse1_duty = 0;
     pulse1_sweep = 0;
     pulse1_timer_low = 0;
     pulse1_length = 0;
     pulse1_timer = 0;
-    pulse1_timer_counter = 0.0f;
+    pulse1_timer_counter = 0;
     pulse1_duty_pos = 0;
     pulse1_volume = 0;
     pulse1_enabled = false;
@@ -633,7 +752,7 @@ void APU::reset() {
     pulse2_timer_low = 0;
     pulse2_length = 0;
     pulse2_timer = 0;
-    pulse2_timer_counter = 0.0f;
+    pulse2_timer_counter = 0;
     pulse2_duty_pos = 0;
     pulse2_volume = 0;
     pulse2_enabled = false;
@@ -661,7 +780,7 @@ void APU::reset() {
     triangle_length_load = 0;
 
     triangle_timer = 0;
-    triangle_timer_counter = 0.0f;
+    triangle_timer_counter = 0;
     triangle_wave_pos = 0;
     triangle_linear_counter = 0;
     triangle_linear_reload_value = 0;
@@ -675,7 +794,7 @@ void APU::reset() {
     noise_length_load = 0;
 
     noise_timer = 0;
-    noise_timer_counter = 0.0f;
+    noise_timer_counter = 0;
     noise_lfsr = 1; // Must initialize to 1 (not 0)
     noise_volume = 0;
     noise_envelope_period = 0;
@@ -688,20 +807,22 @@ void APU::reset() {
     noise_length_halt = false;
     noise_enabled = false;
 
-    // // Reset DMC state
-    // dmc_control = 0;
-    // dmc_output_level = 0;
-    // dmc_sample_address = 0;
-    // dmc_sample_length = 0;
-    //
-    // dmc_current_address = 0;
-    // dmc_bytes_remaining = 0;
-    // dmc_shift_register = 0;
-    // dmc_bits_remaining = 0;
-    // dmc_sample_buffer = 0;
-    // dmc_sample_buffer_empty = true;
-    // dmc_timer_counter = 0.0f;
-    // dmc_timer_period = 428;
-    // dmc_enabled = false;
+    // Reset DMC state
+    dmc_control = 0;
+    dmc_output_level = 0;
+    dmc_sample_address = 0;
+    dmc_sample_length = 0;
+
+    dmc_current_address = 0xC000;
+    dmc_bytes_remaining = 0;
+    dmc_shift_register = 0;
+    dmc_bits_remaining = 8;
+    dmc_sample_buffer = 0;
+    dmc_sample_buffer_empty = true;
+    dmc_silence = true;
+    dmc_timer_period = DMC_RATE_TABLE[0];
+    dmc_timer_counter = dmc_timer_period * 3;
+    dmc_irq_flag = false;
+    dmcFetchPending = false;
 }
 
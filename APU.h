@@ -1,7 +1,11 @@
 #ifndef APU_H
 #define APU_H
 
+#include <array>
 #include <cstdint>
+#include <vector>
+#include "BlipBuffer.h"
+#include "AudioRing.h"
 #define SDL_MAIN_HANDLED
 #include <SDL2/SDL.h>
 class Bus;
@@ -15,14 +19,45 @@ public:
 
     void writeRegister(uint16_t address, uint8_t value);
     uint8_t readRegister(uint16_t address);
-    void generateSamples(float* stream, int length);
+
+    // Audio is synthesized in emulated time: channels step on master clock ticks and every
+    // change in the mixed output goes into a band-limited buffer, so the samples only
+    // depend on what the CPU did, not on how fast the host ran it.
+    static constexpr double CLOCK_RATE = 1789773.0 * 3;    // Master clock ticks per second
+    static constexpr int SAMPLE_RATE = 44100;
+    void synthesize(uint32_t masterCycle);  // Step the channels up to the given tick
+    void endFrame();                        // Resample everything up to clockCounter into samples
+    // Moves samples into audioRing for the device's callback and steers the resampling rate
+    // by how full the ring is, so the buffered audio neither drains nor piles up while the
+    // emulation is paced by video. Does nothing without an audio device.
+    void queueAudio();
+    AudioRing audioRing;                    // Fill level, underruns and overruns are its counters
+    std::vector<float> samples;             // Output samples not handed out yet, newest last
+    int sampleRate = SAMPLE_RATE;           // The audio device's rate if one opened
+
+    // The DAC's nonlinear mix, indexed by channel levels (0-15, DMC 0-127): PULSE_TABLE by
+    // pulse1 + pulse2, TND_TABLE by 3 * triangle + 2 * noise + DMC
+    static const std::array<float, 31> PULSE_TABLE;
+    static const std::array<float, 203> TND_TABLE;
 
     void clockEnvelopeAndLength();
     void clockSweepUnits();
     bool dmc_irq_flag = false;
     bool frame_irq_flag = false;
+    bool irqPending() const { return dmc_irq_flag || frame_irq_flag; }
+
+    // The DMC's sample fetches stall the CPU and the last one may raise its IRQ, so unlike
+    // the rest of the APU they happen at their exact tick: clock() catches the channels up
+    // on the tick it is due, and Bus::runUntil schedules an event for it
+    bool dmcFetchDue() const { return dmcFetchPending; }
+    uint32_t dmcFetchTick() const { return dmcFetchAt - 1; }   // Bus tick whose clock() fetches
+    static constexpr int DMC_STALL_CYCLES = 4;
 
     void clock();       // Step APU internals (envelope, length counter)
+    void runUntil(uint32_t masterCycle);    // clock() up to the given master clock tick
+    uint32_t ticksUntilFrameStep() const;   // clock() calls up to and including the next sequencer step
+    uint32_t ticksUntilEvent() const;       // Same for the next sequencer step or DMC fetch
+    uint32_t clockCounter = 0;              // Master clock ticks run, follows Bus::clockCounter
     void reset();       // Reset APU state
 
 private:
@@ -31,6 +66,21 @@ private:
     int frame_step = 0;
     int frame_sequencer_counter = 0;
 
+    BlipBuffer blip;
+    uint32_t audioClock = 0;    // Tick the channels have been stepped to
+    uint32_t frameStart = 0;    // Tick the blip buffer's current frame started at
+    float lastOutput = 0.0f;    // Mixed output as of audioClock
+    void updateOutput();        // Add a delta if the mixed output changed at audioClock
+    bool audioStarted = false;  // Device unpaused, once the ring first reached its target fill
+    float lastPlayed = 0.0f;    // Callback thread: held over an underrun instead of a click
+    void finishFrame();
+    void clockDmcOutput();      // One DMC timer period: play a bit, maybe take the next byte
+    void fetchDmcSample();      // Memory reader: refill the sample buffer if bytes remain
+    void restartDmcSample();
+    void updateDmcFetch();      // Works out dmcFetchAt from the DMC state at audioClock
+    bool dmcFetchPending = false;
+    uint32_t dmcFetchAt = 0;    // clockCounter as of the clock() that makes the next fetch
+
     // Pulse 1 registers
     uint8_t pulse1_duty;        // $4000: Duty and envelope/volume
     uint8_t pulse1_sweep;       // $4001: Sweep (not implemented)
@@ -39,7 +89,7 @@ private:
 
     // Pulse 1 internal state
     uint16_t pulse1_timer;      // 11-bit timer value
-    float pulse1_timer_counter; // Timing accumulator
+    uint32_t pulse1_timer_counter; // Ticks until the next duty step
     uint8_t pulse1_duty_pos;    // Duty cycle position
     uint8_t pulse1_volume;      // Current volume (from envelope or constant)
     bool pulse1_enabled;        // Channel enabled flag
@@ -72,7 +122,7 @@ private:
 
     // Pulse 2 internal state
     uint16_t pulse2_timer;
-    float pulse2_timer_counter;
+    uint32_t pulse2_timer_counter;
     uint8_t pulse2_duty_pos;
     uint8_t pulse2_volume;
     bool pulse2_enabled;
@@ -104,7 +154,7 @@ private:
 
     // Triangle internal state
     uint16_t triangle_timer;         // 11-bit timer
-    float triangle_timer_counter;    // Accumulator
+    uint32_t triangle_timer_counter; // Ticks until the next step
     uint8_t triangle_wave_pos;       // Position in 32-step waveform
     uint8_t triangle_linear_counter;
     uint8_t triangle_linear_reload_value;
@@ -119,7 +169,7 @@ private:
 
     // Noise internal state
     uint16_t noise_timer;
-    float noise_timer_counter;
+    uint32_t noise_timer_counter;
     uint16_t noise_lfsr;             // 15-bit LFSR
     uint8_t noise_volume;
     uint8_t noise_envelope_period;
@@ -145,9 +195,9 @@ private:
     uint8_t dmc_bits_remaining;
     uint8_t dmc_sample_buffer;
     bool dmc_sample_buffer_empty;
-    float dmc_timer_counter;
-    uint16_t dmc_timer_period;
-    bool dmc_enabled;
+    bool dmc_silence;               // Output unit has no byte to play this time round
+    uint32_t dmc_timer_counter;     // Ticks until the next output unit clock
+    uint16_t dmc_timer_period;      // CPU cycles, from DMC_RATE_TABLE
 
     SDL_AudioSpec audioSpec;
     SDL_AudioDeviceID audioDevice;
@@ -157,6 +207,4 @@ private:
 };
 
 
-// TODO: Implement other sound channels here --> Triangle, Noise, DMC
-
 #endif
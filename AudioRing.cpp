@@ -0,0 +1,44 @@
+#include "AudioRing.h"
+
+#include <algorithm>
+
+size_t AudioRing::write(const float* samples, size_t count) {
+    size_t start = head.load(std::memory_order_relaxed);
+    // Acquire: the consumer is done with the samples before we write over them
+    size_t room = CAPACITY - (start - tail.load(std::memory_order_acquire));
+    if (count > room) {
+        overruns.fetch_add(1, std::memory_order_relaxed);
+        count = room;
+    }
+    for (size_t i = 0; i < count; i++) {
+        buffer[(start + i) & (CAPACITY - 1)] = samples[i];
+    }
+    // Release: the samples are in place before the consumer can see them
+    head.store(start + count, std::memory_order_release);
+    return count;
+}
+
+size_t AudioRing::read(float* out, size_t count) {
+    size_t start = tail.load(std::memory_order_relaxed);
+    size_t available = head.load(std::memory_order_acquire) - start;
+    if (count > available) {
+        underruns.fetch_add(1, std::memory_order_relaxed);
+        count = available;
+    }
+    for (size_t i = 0; i < count; i++) {
+        out[i] = buffer[(start + i) & (CAPACITY - 1)];
+    }
+    tail.store(start + count, std::memory_order_release);
+    return count;
+}
+
+size_t AudioRing::fill() const {
+    // Tail first: head can only have moved on since, so this never comes out negative
+    size_t start = tail.load(std::memory_order_acquire);
+    return head.load(std::memory_order_acquire) - start;
+}
+
+double AudioRing::rateRatio() const {
+    double error = (static_cast<double>(TARGET_FILL) - static_cast<double>(fill())) / TARGET_FILL;
+    return 1.0 + MAX_RATE_DELTA * std::clamp(error, -1.0, 1.0);
+}
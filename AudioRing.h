@@ -0,0 +1,38 @@
+#ifndef AUDIORING_H
+#define AUDIORING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Carries samples from the emulation thread to the audio device's callback without locking.
+// One producer writes and one consumer reads, each only moving its own end of the ring, so
+// a stall on either side costs a few dropped or repeated samples rather than a glitch in
+// the other. The producer also steers how many samples it makes from the fill level.
+class AudioRing {
+public:
+    static constexpr size_t CAPACITY = 8192;        // Power of two, about 185 ms at 44.1 kHz
+    static constexpr size_t TARGET_FILL = 2048;     // Samples of latency rate control aims for
+    static constexpr double MAX_RATE_DELTA = 0.005; // Most the output rate is nudged, either way
+
+    // Producer: adds what fits, the rest is dropped and counted as an overrun
+    size_t write(const float* samples, size_t count);
+    // Consumer: takes what is there, a short read counts as an underrun
+    size_t read(float* out, size_t count);
+
+    size_t fill() const;
+    // Producer: factor for the output sample rate, above 1 when the ring runs low so it
+    // refills and below when it runs high, linear in between and clamped to MAX_RATE_DELTA
+    double rateRatio() const;
+
+    std::atomic<uint32_t> underruns{0};
+    std::atomic<uint32_t> overruns{0};
+
+private:
+    float buffer[CAPACITY]{};
+    // Free-running positions, wrapped by masking; each on its own cache line
+    alignas(64) std::atomic<size_t> head{0};    // Next write, only moved by the producer
+    alignas(64) std::atomic<size_t> tail{0};    // Next read, only moved by the consumer
+};
+
+#endif // AUDIORING_H
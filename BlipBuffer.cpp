@@ -0,0 +1,136 @@
+#include "BlipBuffer.h"
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Windowed sinc impulse for each sub-sample phase, cut off a little below the output
+// Nyquist frequency. Each phase sums to 1 so a delta adds exactly its size once summed.
+BlipBuffer::Kernel BlipBuffer::buildKernel() {
+    const double pi = 3.14159265358979323846;
+    const double cutoff = 0.9;
+    Kernel kernel{};
+    for (int phase = 0; phase < PHASES; phase++) {
+        double sum = 0.0;
+        for (int i = 0; i < KERNEL_WIDTH; i++) {
+            double x = i - KERNEL_WIDTH / 2 + 1 - static_cast<double>(phase) / PHASES;
+            double sinc = x == 0.0 ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+            // Blackman window over the kernel's width
+            double w = (x + KERNEL_WIDTH / 2) / KERNEL_WIDTH;
+            double window = 0.42 - 0.5 * std::cos(2 * pi * w) + 0.08 * std::cos(4 * pi * w);
+            kernel[phase][i] = static_cast<float>(sinc * window);
+            sum += sinc * window;
+        }
+        for (int i = 0; i < KERNEL_WIDTH; i++) {
+            kernel[phase][i] = static_cast<float>(kernel[phase][i] / sum);
+        }
+    }
+    return kernel;
+}
+
+const BlipBuffer::Kernel BlipBuffer::KERNEL = BlipBuffer::buildKernel();
+
+BlipBuffer::BlipBuffer(double clockRate, double sampleRate, int capacity)
+    : buffer(capacity + KERNEL_WIDTH, 0.0f) {
+    setRates(clockRate, sampleRate);
+}
+
+void BlipBuffer::setRates(double clockRate, double sampleRate) {
+    this->sampleRate = sampleRate;
+    factor = static_cast<uint64_t>(sampleRate / clockRate * (1ull << FRAC_BITS));
+    // About 20 Hz, below anything the APU plays
+    highPassRate = static_cast<float>(1.0 - std::exp(-2.0 * 3.14159265358979323846 * 20.0 / sampleRate));
+}
+
+// Where a delta at the given time goes, nullptr past the end of a frame that ran too long
+// (see maxFrameTicks)
+float* BlipBuffer::deltaTarget(uint32_t time, int& phase) {
+    uint64_t position = offset + time * factor;
+    size_t index = static_cast<size_t>(position >> FRAC_BITS);
+    phase = static_cast<int>(position >> (FRAC_BITS - PHASE_BITS)) & (PHASES - 1);
+    return index + KERNEL_WIDTH <= buffer.size() ? &buffer[index] : nullptr;
+}
+
+static void addKernelScalar(float* out, const float* kernel, float delta) {
+    for (int i = 0; i < BlipBuffer::KERNEL_WIDTH; i++) {
+        out[i] += delta * kernel[i];
+    }
+}
+
+#ifdef CPUFEATURES_X86
+// No FMA: it must add up exactly like the SSE and scalar kernels
+__attribute__((target("avx")))
+static void addKernelAvx(float* out, const float* kernel, float delta) {
+    const __m256 scale = _mm256_set1_ps(delta);
+    for (int i = 0; i < BlipBuffer::KERNEL_WIDTH; i += 8) {
+        __m256 taps = _mm256_mul_ps(scale, _mm256_load_ps(kernel + i));
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), taps));
+    }
+}
+#endif
+
+static void addKernel(float* out, const float* kernel, float delta) {
+#ifdef CPUFEATURES_X86
+    if (cpuHasAvx()) {
+        addKernelAvx(out, kernel, delta);
+        return;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(delta);
+    for (int i = 0; i < BlipBuffer::KERNEL_WIDTH; i += 4) {
+        __m128 taps = _mm_mul_ps(scale, _mm_load_ps(kernel + i));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), taps));
+    }
+#else
+    addKernelScalar(out, kernel, delta);
+#endif
+}
+
+void BlipBuffer::addDelta(uint32_t time, float delta) {
+    int phase;
+    if (float* out = deltaTarget(time, phase)) {
+        addKernel(out, KERNEL[phase].data(), delta);
+    }
+}
+
+void BlipBuffer::addDeltaScalar(uint32_t time, float delta) {
+    int phase;
+    if (float* out = deltaTarget(time, phase)) {
+        addKernelScalar(out, KERNEL[phase].data(), delta);
+    }
+}
+
+void BlipBuffer::endFrame(uint32_t ticks) {
+    offset += ticks * factor;
+}
+
+uint32_t BlipBuffer::maxFrameTicks() const {
+    uint64_t room = (static_cast<uint64_t>(buffer.size() - KERNEL_WIDTH) << FRAC_BITS) - offset;
+    return static_cast<uint32_t>(std::min<uint64_t>(room / factor, UINT32_MAX));
+}
+
+int BlipBuffer::readSamples(float* out, int count) {
+    count = std::min(count, samplesAvailable());
+    for (int i = 0; i < count; i++) {
+        integrator += buffer[i];
+        highPass += (integrator - highPass) * highPassRate;
+        out[i] = integrator - highPass;
+    }
+    // Keep what the kernels spread past the samples taken
+    std::copy(buffer.begin() + count, buffer.end(), buffer.begin());
+    std::fill(buffer.end() - count, buffer.end(), 0.0f);
+    offset -= static_cast<uint64_t>(count) << FRAC_BITS;
+    return count;
+}
+
+void BlipBuffer::clear() {
+    std::fill(buffer.begin(), buffer.end(), 0.0f);
+    offset = 0;
+    integrator = 0.0f;
+    highPass = 0.0f;
+}
@@ -0,0 +1,57 @@
+#ifndef BLIPBUFFER_H
+#define BLIPBUFFER_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Band-limited synthesis buffer: the APU adds a delta whenever its output changes, timed in
+// clock ticks, and each delta goes in as a band-limited step so square waves at any pitch
+// come out at the output rate without aliasing. Samples become readable once endFrame says
+// how many ticks the frame had.
+//
+// This is the resampler from the APU's clock to the output rate, a polyphase FIR filter run
+// on the changes in the signal rather than every tick of it: a delta picks the phase of
+// the kernel from where it falls between two output samples and adds all of that phase's
+// taps at once, with SSE (AVX where the CPU has it).
+class BlipBuffer {
+public:
+    static constexpr int KERNEL_WIDTH = 16;     // Output samples each step is spread over
+    static constexpr int PHASE_BITS = 5;        // Sub-sample positions a step can start at
+    static constexpr int PHASES = 1 << PHASE_BITS;
+
+    // capacity is the most samples a frame (plus those not read yet) may produce
+    BlipBuffer(double clockRate, double sampleRate, int capacity);
+    void setRates(double clockRate, double sampleRate);
+
+    // time is in ticks from the start of the current frame
+    void addDelta(uint32_t time, float delta);
+    // Same result one tap at a time, the reference for tests and the benchmark
+    void addDeltaScalar(uint32_t time, float delta);
+    void endFrame(uint32_t ticks);
+    // Ticks a frame can last before it runs out of room
+    uint32_t maxFrameTicks() const;
+
+    int samplesAvailable() const { return static_cast<int>(offset >> FRAC_BITS); }
+    // Takes up to count samples, returns how many it took
+    int readSamples(float* out, int count);
+    void clear();
+
+private:
+    static constexpr int FRAC_BITS = 32;
+    uint64_t factor = 0;            // Output samples per tick, 32.32 fixed point
+    uint64_t offset = 0;            // Where the current frame starts, in output samples
+    double sampleRate = 0;
+    std::vector<float> buffer;      // Output sample differences, summed on the way out
+    float integrator = 0.0f;
+    float highPass = 0.0f;          // Slow running average taken out as DC
+    float highPassRate = 0.0f;
+
+    // Rows are 64 bytes so a phase is whole vector loads
+    using Kernel = std::array<std::array<float, KERNEL_WIDTH>, PHASES>;
+    alignas(64) static const Kernel KERNEL;
+    static Kernel buildKernel();
+    float* deltaTarget(uint32_t time, int& phase);
+};
+
+#endif // BLIPBUFFER_H
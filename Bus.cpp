@@ -1,5 +1,6 @@
 #include "Bus.h"
 #include "CPU.h"
+#include <algorithm>
 #include <thread>
 #include <iostream>
 
@@ -8,6 +9,7 @@ Bus::Bus() {
     apu = new APU();
     cpu->connectBus(this);  // Connect CPU to Bus
     apu->connectBus(this);
+    mapMemory();
 }
 
 Bus::~Bus() {
@@ -16,26 +18,50 @@ Bus::~Bus() {
 }
 
 void Bus::write(uint16_t address, uint8_t data) {
+#ifdef BUS_REFERENCE_MAP
+    writeReference(address, data);
+#else
+    const MemoryPage& page = memoryMap[address >> 8];
+    if (page.write) {
+        page.write[address & 0xFF] = data;
+        cpu->invalidateDecoded(address);
+        return;
+    }
+    (this->*page.writeHandler)(address, data);
+#endif
+}
+
+void Bus::writeReference(uint16_t address, uint8_t data) {
     // Handles CPU RAM --> 0x0000-0x1FFF (mirrored every 0x0800)
     if (address <= 0x1FFF) {
         cpuRam[address & 0x07FF] = data;
+        cpu->invalidateDecoded(address);
         return;
     }
 
     // Handles PPU registers --> 0x2000-0x3FFF (mirrored every 8 bytes)
     if (address >= 0x2000 && address <= 0x3FFF) {
+        syncPpu();
         ppu.cpuWrite(address & 0x0007, data);
         return;
     }
 
     // Handles APU registers --> 0x4000-0x4013, 0x4015, 0x4017
     if ((address >= 0x4000 && address <= 0x4013) || address == 0x4015 || address == 0x4017) {
+        if (devicesDeferred) {
+            apu->runUntil(clockCounter + 1);
+        }
         apu->writeRegister(address, data);
+        if (devicesDeferred) {
+            scheduleDmc();
+        }
         return;
     }
 
     // Handles OAM DMA --> 0x4014
     if (address == 0x4014) {
+        // Everything the PPU did up to now has to see OAM from before the transfer
+        syncPpu();
         DMATransfer = true;
         DMAPage = data;
         DMAAddress = 0x00;
@@ -79,15 +105,17 @@ void Bus::write(uint16_t address, uint8_t data) {
             }
         }
 
+        cpu->invalidateDecoded(address);
         return;
     }
 
     // Default fallback (always works for tests)
     testFallbackRAM[address] = data;
+    cpu->invalidateDecoded(address);
 }
 
 
-uint8_t Bus::read(uint16_t address) {
+uint8_t Bus::readReference(uint16_t address) {
     if (rom == nullptr) {
         std::cerr << "ERROR: Bus::read() called before ROM is connected! Address: 0x"
                   << std::hex << address << "\n";
@@ -100,11 +128,15 @@ uint8_t Bus::read(uint16_t address) {
 
     // Handles PPU registers --> 0x2000-0x3FFF
     if (address >= 0x2000 && address <= 0x3FFF) {
+        syncPpu();
         return ppu.cpuRead(address & 0x0007);
     }
 
     // Handles APU registers --> 0x4000–0x4017
     if ((address >= 0x4000 && address <= 0x4013) || address == 0x4015 || address == 0x4017) {
+        if (devicesDeferred) {
+            apu->runUntil(clockCounter + 1);
+        }
         return apu->readRegister(address);
     }
 
@@ -136,12 +168,73 @@ uint8_t Bus::read(uint16_t address) {
 }
 
 
+uint8_t Bus::readPpuRegister(uint16_t address) {
+    syncPpu();
+    return ppu.cpuRead(address & 0x0007);
+}
+
+void Bus::writePpuRegister(uint16_t address, uint8_t data) {
+    syncPpu();
+    ppu.cpuWrite(address & 0x0007, data);
+}
+
+void Bus::mapMemory() {
+    memoryMap.fill(MemoryPage{});
+
+    // CPU RAM --> 0x0000-0x1FFF, 2KB mirrored
+    for (int page = 0x00; page <= 0x1F; page++) {
+        uint8_t* memory = cpuRam.data() + ((page & 0x07) << 8);
+        memoryMap[page].read = memory;
+        memoryMap[page].write = memory;
+    }
+
+    // PPU registers --> 0x2000-0x3FFF
+    for (int page = 0x20; page <= 0x3F; page++) {
+        memoryMap[page].readHandler = &Bus::readPpuRegister;
+        memoryMap[page].writeHandler = &Bus::writePpuRegister;
+    }
+
+    // Without a cartridge the rest is test RAM. Page 0x40 holds the APU, DMA and
+    // controller ports and always goes through the full decode.
+    if (rom == nullptr) {
+        for (int page = 0x41; page <= 0xFF; page++) {
+            memoryMap[page].read = testFallbackRAM + (page << 8);
+            memoryMap[page].write = testFallbackRAM + (page << 8);
+        }
+        return;
+    }
+
+    // NROM-128 or NROM-256 PRG-ROM --> 0x8000-0xFFFF, the rest of the cartridge space
+    // stays on the full decode
+    bool nrom = rom->ROMheader.flags6 == 0x00 || rom->ROMheader.flags6 == 0x01;
+    uint32_t prgSize = rom->ROMheader.prgRomSize * 16 * 1024;
+    if (!nrom || prgSize == 0 || rom->prgRom == nullptr) {
+        return;
+    }
+    for (int page = 0x80; page <= 0xFF; page++) {
+        uint32_t address = page << 8;
+        if (rom->mirrored) {
+            memoryMap[page].read = rom->prgRom + (address & 0x3FFF);
+            // Only the upper copy takes writes
+            if (address >= 0xC000) {
+                memoryMap[page].write = rom->prgRom + (address - 0xC000);
+            }
+        }
+        else if (address - 0x8000 < prgSize) {
+            memoryMap[page].read = rom->prgRom + (address - 0x8000);
+            memoryMap[page].write = rom->prgRom + (address - 0x8000);
+        }
+    }
+}
+
 void Bus::reset() {
     cpu->reset();
     apu->reset();
     ppu.reset();
     clockCounter = 0;
     cpuClockCounter = 0;
+    ppu.clockCounter = 0;
+    apu->clockCounter = 0;
     DMATransfer = false;
     DMACanStart = false;
     DMAPage = 0x00;
@@ -153,41 +246,23 @@ void Bus::clock() {
     // Cycle ppu & apu every clock cycle
     ppu.clock();
     apu->clock();
+    clockCpu();
+}
 
-    // if (apu->dmc_irq_flag && !cpu->getFlag(CPU::FLAGS::I)) {
-    //     cpu->irq_interrupt();
-    // }
-
+void Bus::clockCpu() {
     // CPU is three times slower than ppu
     if (clockCounter % 3 == 0) {
 
         // Check if a DMA transfer is happening, it suspends the CPU
         if (DMATransfer) {
-            if (!DMACanStart) {
-                if (clockCounter % 2 == 1) {
-                    DMACanStart = true;
-                }
-            }
-            else {
-                // Read from the CPU bus on even clock cycles
-                if (clockCounter % 2 == 0) {
-                    DMAData = read(DMAPage << 8 | DMAAddress);
-                }
-                // Write to PPU OAM memory on odd clock cycles
-                else {
-                    ppu.OAMDATA[DMAAddress] = DMAData;
-                    DMAAddress++;
-
-                    // After transfering 256 bytes end the transfer
-                    if (DMAAddress == 0x00) {
-                        DMATransfer = false;
-                        DMACanStart = false;
-                    }
-                }
-            }
+            dmaSlot(clockCounter);
         }
         // If no DMA transfer, cycle CPU
         else {
+            // IRQs are taken between instructions, while the line is held
+            if (cpu->cycles == 0 && apu->irqPending() && !cpu->getFlag(CPU::FLAGS::I)) {
+                cpu->irq_interrupt();
+            }
             cpu->cycleExecute();
             cpuClockCounter++;
         }
@@ -203,8 +278,212 @@ void Bus::clock() {
     clockCounter++;
 }
 
+void Bus::dmaSlot(uint32_t tick) {
+    if (!DMACanStart) {
+        if (tick % 2 == 1) {
+            DMACanStart = true;
+        }
+    }
+    else {
+        // Read from the CPU bus on even clock cycles
+        if (tick % 2 == 0) {
+            DMAData = read(DMAPage << 8 | DMAAddress);
+        }
+        // Write to PPU OAM memory on odd clock cycles
+        else {
+            ppu.writeOAM(DMAAddress, DMAData);
+            DMAAddress++;
+
+            // After transfering 256 bytes end the transfer
+            if (DMAAddress == 0x00) {
+                DMATransfer = false;
+                DMACanStart = false;
+            }
+        }
+    }
+}
+
+void Bus::stallCpu(int cycles) {
+    cpu->cycles += cycles;
+}
+
+// ----- EVENT SCHEDULING ----- //
+
+// Between two events nothing but the CPU's cycle count changes as far as the CPU can tell:
+// it does all of an instruction's work on its first cycle, the APU only changes state on its
+// frame sequencer steps, and an NMI can only be raised at vblank. So runUntil runs the CPU
+// from one instruction to the next and leaves the PPU and APU behind. They are caught up at
+// their events, when the CPU accesses their registers (or starts OAM DMA), and at the end,
+// so the PPU runs its dots in long batches.
+//
+// During OAM DMA the CPU is suspended and the DMA slots are run in batches as well. RAM
+// can't change under them, but the PPU reads OAM for every scanline, so each sprite
+// evaluation is an event too. DMA from PPU/APU registers goes one tick at a time.
+void Bus::runUntil(uint32_t masterCycle) {
+    scheduleEvents();
+    devicesDeferred = true;
+
+    while (clockCounter != masterCycle) {
+        uint64_t untilEvent = masterCycle - clockCounter;
+        if (!DMATransfer) {
+            // Ticks before the next CPU slot, and before the slot that starts an instruction
+            uint32_t untilSlot = (3 - clockCounter % 3) % 3;
+            untilEvent = std::min<uint64_t>(untilEvent, untilSlot + 3ull * cpu->cycles);
+        }
+        if (!scheduler.empty()) {
+            untilEvent = std::min<uint64_t>(untilEvent, scheduler.nextTick() - clockCounter);
+        }
+
+        bool dmaFromRegisters = DMATransfer && DMAPage >= 0x20 && DMAPage < 0x60;
+        // The slot pattern breaks where clockCounter wraps, take those ticks one by one
+        if (untilEvent == 0 || dmaFromRegisters || clockCounter + untilEvent > UINT32_MAX) {
+            clockEvent();
+            continue;
+        }
+
+        uint32_t stop = clockCounter + untilEvent;
+        uint32_t firstSlot = clockCounter + (3 - clockCounter % 3) % 3;
+        if (DMATransfer) {
+            for (uint32_t tick = firstSlot; tick < stop; tick += 3) {
+                dmaSlot(tick);
+            }
+        }
+        else {
+            uint32_t slots = firstSlot < stop ? (stop - firstSlot + 2) / 3 : 0;
+            cpu->cycles -= slots;
+            cpuClockCounter += slots;
+        }
+        clockCounter = stop;
+    }
+
+    ppu.catchUp(clockCounter);
+    apu->runUntil(clockCounter);
+    devicesDeferred = false;
+}
+
+void Bus::clockEvent() {
+    uint32_t tick = clockCounter;
+    // Events need the PPU at this tick: vblank raises the NMI the CPU takes at the end of
+    // it, and sprite evaluation reads OAM before this tick's DMA slot writes it. The APU
+    // too, a DMC fetch stalls the CPU from this tick's slot on.
+    if (!scheduler.empty() && scheduler.nextTick() == tick) {
+        ppu.catchUp(tick + 1);
+        apu->runUntil(tick + 1);
+    }
+    clockCpu();
+
+    Scheduler::Event event;
+    while (scheduler.popDue(tick, event)) {
+        handleEvent(event);
+    }
+    if (DMATransfer && !scheduler.pending(Scheduler::DMA_COMPLETE)) {
+        scheduleDma();
+    }
+}
+
+void Bus::scheduleEvents() {
+    scheduler.clear();
+    scheduler.schedule(Scheduler::VBLANK, nextDotTick(241, 1, clockCounter));
+    apu->runUntil(clockCounter);
+    scheduler.schedule(Scheduler::FRAME_SEQUENCER, clockCounter + apu->ticksUntilFrameStep() - 1);
+    scheduleDmc();
+    if (DMATransfer) {
+        scheduleDma();
+    }
+}
+
+void Bus::scheduleDmc() {
+    if (apu->dmcFetchDue()) {
+        scheduler.schedule(Scheduler::DMC_FETCH, apu->dmcFetchTick());
+    } else {
+        scheduler.cancel(Scheduler::DMC_FETCH);
+    }
+}
+
+void Bus::scheduleDma() {
+    scheduler.schedule(Scheduler::DMA_COMPLETE, dmaCompleteTick());
+    scheduler.schedule(Scheduler::SPRITE_EVALUATION, nextSpriteEvaluation());
+}
+
+// Called after the event's tick, so clockCounter is already the tick after it
+void Bus::handleEvent(Scheduler::Event event) {
+    switch (event) {
+        case Scheduler::VBLANK:
+            // The tick itself raised the NMI (if enabled), this just finds the next one
+            scheduler.schedule(Scheduler::VBLANK, nextDotTick(241, 1, clockCounter));
+            break;
+        case Scheduler::FRAME_SEQUENCER:
+            apu->runUntil(clockCounter);
+            scheduler.schedule(Scheduler::FRAME_SEQUENCER, clockCounter + apu->ticksUntilFrameStep() - 1);
+            break;
+        case Scheduler::DMC_FETCH:
+            // Fetched before the tick's CPU slot, see clockEvent
+            scheduleDmc();
+            break;
+        case Scheduler::DMA_COMPLETE:
+            scheduler.cancel(Scheduler::SPRITE_EVALUATION);
+            break;
+        case Scheduler::SPRITE_EVALUATION:
+            if (DMATransfer) {
+                scheduler.schedule(Scheduler::SPRITE_EVALUATION, nextSpriteEvaluation());
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Tick of the last OAM write, found by stepping the DMA slots the way clock() would
+uint32_t Bus::dmaCompleteTick() const {
+    bool canStart = DMACanStart;
+    int writesLeft = 256 - DMAAddress;
+    for (uint32_t tick = clockCounter; ; tick++) {
+        if (tick % 3 != 0) {
+            continue;
+        }
+        if (!canStart) {
+            canStart = tick % 2 == 1;
+        }
+        else if (tick % 2 == 1 && --writesLeft == 0) {
+            return tick;
+        }
+    }
+}
+
+// Tick at which the PPU next reads OAM, dot 257 of scanlines 0-260
+uint32_t Bus::nextSpriteEvaluation() const {
+    uint32_t position = dotAt(clockCounter);
+    int scanline = position / 341 - 1;
+    if (scanline < 0 || position % 341 > 257) {
+        scanline++;
+    }
+    if (scanline > 260) {
+        scanline = 0;
+    }
+    return nextDotTick(scanline, 257, clockCounter);
+}
+
+// Frames run from scanline -1 to 260, 341 dots each. The PPU may be behind, but it runs
+// one dot per tick, so where it will be at a later tick is known.
+uint32_t Bus::dotAt(uint32_t tick) const {
+    uint32_t current = (ppu.scanline + 1) * 341 + ppu.cycle;
+    return (current + (tick - ppu.clockCounter) % FRAME_DOTS) % FRAME_DOTS;
+}
+
+uint32_t Bus::nextDotTick(int scanline, int dot, uint32_t from) const {
+    uint32_t target = (scanline + 1) * 341 + dot;
+    return from + (target + FRAME_DOTS - dotAt(from)) % FRAME_DOTS;
+}
+
+uint32_t Bus::ticksUntilDot(int scanline, int dot) const {
+    return nextDotTick(scanline, dot, clockCounter + 1) - clockCounter;
+}
+
 void Bus::connectROM(NESROM& ROM) {
     std::cout << "Bus::connectROM() called — assigning rom pointer!\n";
     ppu.connectROM(ROM);
     rom = &ROM;
+    mapMemory();
+    // New PRG mapped in, drop anything decoded from the old one
+    cpu->invalidateDecodedRange(0x8000, 0xFFFF);
 }
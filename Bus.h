@@ -6,6 +6,7 @@
 #include "PPU.h"
 #include "ROM.h"
 #include "APU.h"
+#include "Scheduler.h"
 
 class CPU;
 class APU;
@@ -20,7 +21,7 @@ public:
     APU* apu;
     PPU  ppu;
     std::array<uint8_t, 2 * 1024> cpuRam{}; // 2KB of CPU RAM
-    NESROM* rom;
+    NESROM* rom = nullptr;
 
 
     union controller {
@@ -34,26 +35,109 @@ public:
             uint8_t left: 1;
             uint8_t right: 1;
         }; uint8_t reg;
-    } controller1;
-    controller copyController;
+    } controller1{};
+    controller copyController{};
     int controller_read = 0;
 
-    // Bus read and write functions
+    // Bus read and write functions. RAM and ROM pages are a single lookup in the memory
+    // map below, I/O pages go to their handler. Build with BUS_MAP=reference to decode
+    // every access the long way instead.
     void write(uint16_t address, uint8_t data);
-    uint8_t read(uint16_t address);
+    uint8_t read(uint16_t address) {
+#ifdef BUS_REFERENCE_MAP
+        return readReference(address);
+#else
+        const MemoryPage& page = memoryMap[address >> 8];
+        if (page.read) {
+            return page.read[address & 0xFF];
+        }
+        return (this->*page.readHandler)(address);
+#endif
+    }
+
+    // Full address decode, what the memory map is built to match
+    void writeReference(uint16_t address, uint8_t data);
+    uint8_t readReference(uint16_t address);
+
+    // ----- MEMORY MAP ----- //
+
+    // One entry per 256 byte page of the CPU address space. Pages backed by plain memory
+    // point straight at it, everything else has a handler.
+    using ReadHandler = uint8_t (Bus::*)(uint16_t address);
+    using WriteHandler = void (Bus::*)(uint16_t address, uint8_t data);
+    struct MemoryPage {
+        uint8_t* read = nullptr;        // Host memory for the page, or nullptr for readHandler
+        uint8_t* write = nullptr;       // Host memory for the page, or nullptr for writeHandler
+        ReadHandler readHandler = &Bus::readReference;
+        WriteHandler writeHandler = &Bus::writeReference;
+    };
+    std::array<MemoryPage, 256> memoryMap{};
+
+    // Rebuilds the memory map from RAM and the connected ROM. Call it whenever rom
+    // changes, and from a mapper after a bank switch.
+    void mapMemory();
 
     void reset();
     void clock();
+    // Same result as clock() until clockCounter reaches masterCycle, but only ticks that
+    // start an instruction or have a scheduled event are run in full
+    void runUntil(uint32_t masterCycle);
+
+    // Master clock ticks until the PPU processes the given dot, at least 1 (0 would be the
+    // dot already processed this tick). Used to find how far the CPU may safely run ahead.
+    uint32_t ticksUntilDot(int scanline, int dot) const;
+    // Master clock ticks until the DMC next fetches a sample byte, UINT32_MAX if it won't.
+    // Like vblank, a point the CPU must not run past unawares.
+    uint32_t ticksUntilDmcFetch() const {
+        return apu->dmcFetchDue() ? apu->dmcFetchTick() - clockCounter : UINT32_MAX;
+    }
+    // DMA taking the bus from the CPU for a number of its cycles
+    void stallCpu(int cycles);
+    // First master clock tick from `from` on at which the PPU processes the given dot
+    uint32_t nextDotTick(int scanline, int dot, uint32_t from) const;
+    static constexpr uint32_t FRAME_DOTS = 262 * 341;
+
+    // Brings the PPU up to the tick the CPU is in, before the CPU looks at its state.
+    // Only does anything inside runUntil, clock() keeps the PPU in step anyway.
+    void syncPpu() {
+        if (devicesDeferred) {
+            ppu.catchUp(clockCounter + 1);
+        }
+    }
 
     // Connect Game Rom to Bus
     void connectROM(NESROM& ROM);
 
     uint32_t clockCounter = 0;
     uint32_t cpuClockCounter = 0;
+    // Master clock tick the CPU must not run whole blocks past, where its state is
+    // observed from outside (set per frame by NES::cycle)
+    uint32_t syncClock = UINT32_MAX;
+
+    // Device events runUntil stops at, rebuilt from device state each time it starts
+    Scheduler scheduler;
 
     // Fallback RAM for testing without ROM
     uint8_t testFallbackRAM[0x10000]{};
 private:
+    uint8_t readPpuRegister(uint16_t address);
+    void writePpuRegister(uint16_t address, uint8_t data);
+
+    // Inside runUntil the PPU and APU only run at scheduled events, at the end, and when
+    // the CPU accesses one of their registers
+    bool devicesDeferred = false;
+
+    void clockCpu();                // CPU or DMA slot, NMI, end of the tick
+    void clockEvent();              // One CPU tick with the devices deferred, then its events
+    void dmaSlot(uint32_t tick);    // One CPU slot of an OAM DMA transfer
+    void scheduleEvents();
+    void scheduleDma();
+    void scheduleDmc();
+    void handleEvent(Scheduler::Event event);
+    uint32_t dmaCompleteTick() const;
+    uint32_t nextSpriteEvaluation() const;
+    uint32_t dotAt(uint32_t tick) const;   // Frame position of the dot the PPU runs at tick
+
     // Device status
 
     bool DMATransfer = false;
@@ -1,14 +1,15 @@
 #include "CPU.h"
 #include "Bus.h"
+#include "Dynarec.h"
+#include <algorithm>
 #include <cstdio>
 #include <cstdint>
 #include <iostream>
 #include <iomanip>
+#include <string>
 
 CPU::CPU() : bus(nullptr), A(0x00), X(0x00), Y(0x00), S(0xFD), PC(0x0000), P(0x00), cycles(0) {
     std::cout << "CPU constructor: PC = " << std::hex << PC << "\n";
-    initInstructionTable();
-    std::cout << "After initInstructionTable: PC = " << std::hex << PC << "\n";
 }
 
 CPU::~CPU() {
@@ -38,6 +39,16 @@ uint8_t CPU::readBus(uint16_t address) {
 
 // Sets or clears a bit of the status register
 void CPU::setFlag(FLAGS flag, bool set) {
+#ifndef CPU_EAGER_FLAGS
+    switch (flag) {
+        case C: carry = set; return;
+        case V: overflow = set; return;
+        // N and Z set on their own, encoded so the other one keeps its value
+        case Z: nzResult = (getFlag(N) ? 0x100 : 0) | (set ? 0 : 1); return;
+        case N: nzResult = (set ? 0x100 : 0) | (getFlag(Z) ? 0 : 1); return;
+        default: break;
+    }
+#endif
     if (set)
         P |= flag;  // Set the flag
     else
@@ -46,13 +57,51 @@ void CPU::setFlag(FLAGS flag, bool set) {
 
 // Gets the flag value of a bit of the status register
 uint8_t CPU::getFlag(FLAGS flag) const {
+#ifndef CPU_EAGER_FLAGS
+    switch (flag) {
+        case C: return carry;
+        case V: return overflow;
+        case Z: return static_cast<uint8_t>(nzResult) == 0;
+        case N: return (nzResult & 0x180) != 0;
+        default: break;
+    }
+#endif
     return ((P & flag) != 0) ? 1 : 0;
 }
 
+// Sets N and Z the way almost every instruction does, from the value it produced
+void CPU::setNZ(uint8_t result) {
+#ifndef CPU_EAGER_FLAGS
+    nzResult = result;
+#else
+    P = (P & ~(N | Z)) | (result & N) | (result == 0 ? Z : 0);
+#endif
+}
+
+// The status register with every flag in place, for PHP, interrupts and the debugger
+uint8_t CPU::status() const {
+#ifndef CPU_EAGER_FLAGS
+    return P | carry | (overflow ? V : 0) | (getFlag(Z) ? Z : 0) | (getFlag(N) ? N : 0);
+#else
+    return P;
+#endif
+}
+
+void CPU::setStatus(uint8_t value) {
+#ifndef CPU_EAGER_FLAGS
+    P = value & ~(C | Z | V | N);
+    carry = value & C;
+    overflow = (value & V) != 0;
+    nzResult = ((value & N) << 1) | ((value & Z) ? 0 : 1);
+#else
+    P = value;
+#endif
+}
+
 // Print the CPU registers
 void CPU::printRegisters() const {
   printf("A: [%02X]\nX: [%02X]\nY: [%02X]\nPC: [%04X]\nS: [%02X]\nP: [%02X]\n",
-    A, X, Y, PC-1, S, P);
+    A, X, Y, PC-1, S, status());
 }
 
 
@@ -84,7 +133,7 @@ void CPU::reset() {
 
     // Step 4: Reset stack and flags
     S = 0xFD;
-    P = 0x00;
+    setStatus(0x00);
     std::cout << "Stack pointer reset to 0xFD, Status set to 0x00\n";
 
     setFlag(I, true);
@@ -108,11 +157,33 @@ int CPU::cycleExecute() {
 
     // Ready to run next instruction
     if (cycles == 0) {
+        // Spinning in a loop that can't change anything, skip ahead
+        if (idleSkip && skipIdleLoop()) {
+            cycles--;
+            return 0;
+        }
+
+        // Compiled block starting here, run as a whole
+        if (dynarec && dynarec->run()) {
+            cycles--;
+            return 0;
+        }
+
+        // Predecoded RAM/ROM instruction, operand already fetched
+        DecodedInstruction* decoded = predecode ? decodedAt(PC) : nullptr;
+        if (decoded) {
+            PC++;
+            decoded->handler(*this, decoded->operand);
+            cycles--;
+            return 0;
+        }
+
         // Read the opcode
         uint8_t opcode = readBus(PC++);
         // printf("Opcode: %02X\n", opcode);
         // printRegisters();
 
+#ifdef CPU_DISPATCH_TABLE
         // Get the address mode and instruction type from the opcode
         //std::cout << "Opcode: 0x" << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << static_cast<int>(opcode) << std::endl;
         Instruction opcodeInstr = instructionTable[opcode];
@@ -132,6 +203,10 @@ int CPU::cycleExecute() {
         if (res.additionalCycles) {
             cycles += instrCycles;
         }
+#else
+        // Run the fused handler for the opcode (addressing mode + operation + cycles)
+        dispatch(opcode);
+#endif
 
         // Return ran
         ran = 0;
@@ -147,289 +222,468 @@ int CPU::cycleExecute() {
 // ---------------------------------------------------------------------------- //
 // ----------------------------- INSTRUCTIONS TABLE --------------------------- //
 // ---------------------------------------------------------------------------- //
-void CPU::initInstructionTable() {
+
+// Member function implementing an addressing mode
+constexpr CPU::AddressResult (CPU::*modeFunction(AddrMode mode))() {
+    switch (mode) {
+#define X(name, bytes, cycles, addsOpCycles, pageCross) case AddrMode::name: return &CPU::name;
+        CPU_ADDRESSING_MODES(X)
+#undef X
+    }
+    return nullptr;
+}
+
+// Member function implementing an operation
+constexpr int (CPU::*operationFunction(Op op))(uint16_t) {
+    switch (op) {
+#define X(name, access, cycles) case Op::name: return &CPU::name;
+        CPU_OPERATIONS(X)
+#undef X
+        case Op::Invalid: break;
+    }
+    return nullptr;
+}
+
+// Legacy member-function-pointer table, built at compile time from OPCODE_TABLE
+constexpr std::array<CPU::Instruction, 256> makeInstructionTable() {
+    std::array<CPU::Instruction, 256> table{};
     for (int i = 0; i < 256; i++) {
-        instructionTable[i] = {nullptr, nullptr};
-    }
-
-    // LDA
-    instructionTable[0xA9] = {&CPU::LDA, &CPU::Immediate};
-    instructionTable[0xA5] = {&CPU::LDA, &CPU::ZeroPage};
-    instructionTable[0xB5] = {&CPU::LDA, &CPU::ZeroPageX};
-    instructionTable[0xAD] = {&CPU::LDA, &CPU::Absolute};
-    instructionTable[0xBD] = {&CPU::LDA, &CPU::AbsoluteX};
-    instructionTable[0xB9] = {&CPU::LDA, &CPU::AbsoluteY};
-    instructionTable[0xA1] = {&CPU::LDA, &CPU::IndirectX};
-    instructionTable[0xB1] = {&CPU::LDA, &CPU::IndirectY};
-
-    // LDX
-    instructionTable[0xA2] = {&CPU::LDX, &CPU::Immediate};
-    instructionTable[0xA6] = {&CPU::LDX, &CPU::ZeroPage};
-    instructionTable[0xB6] = {&CPU::LDX, &CPU::ZeroPageY};
-    instructionTable[0xAE] = {&CPU::LDX, &CPU::Absolute};
-    instructionTable[0xBE] = {&CPU::LDX, &CPU::AbsoluteY};
-
-    // LDY
-    instructionTable[0xA0] = {&CPU::LDY, &CPU::Immediate};
-    instructionTable[0xA4] = {&CPU::LDY, &CPU::ZeroPage};
-    instructionTable[0xB4] = {&CPU::LDY, &CPU::ZeroPageX};
-    instructionTable[0xAC] = {&CPU::LDY, &CPU::Absolute};
-    instructionTable[0xBC] = {&CPU::LDY, &CPU::AbsoluteX};
-
-    // STA
-    instructionTable[0x85] = {&CPU::STA, &CPU::ZeroPage};
-    instructionTable[0x95] = {&CPU::STA, &CPU::ZeroPageX};
-    instructionTable[0x8D] = {&CPU::STA, &CPU::Absolute};
-    instructionTable[0x9D] = {&CPU::STA, &CPU::AbsoluteX};
-    instructionTable[0x99] = {&CPU::STA, &CPU::AbsoluteY};
-    instructionTable[0x81] = {&CPU::STA, &CPU::IndirectX};
-    instructionTable[0x91] = {&CPU::STA, &CPU::IndirectY};
-
-    // STX
-    instructionTable[0x86] = {&CPU::STX, &CPU::ZeroPage};
-    instructionTable[0x96] = {&CPU::STX, &CPU::ZeroPageY};
-    instructionTable[0x8E] = {&CPU::STX, &CPU::Absolute};
-
-    // STY
-    instructionTable[0x84] = {&CPU::STY, &CPU::ZeroPage};
-    instructionTable[0x94] = {&CPU::STY, &CPU::ZeroPageX};
-    instructionTable[0x8C] = {&CPU::STY, &CPU::Absolute};
-
-    // TAX, TAY, TSX, TXA, TXS, TYA
-    instructionTable[0xAA] = {&CPU::TAX, &CPU::Implicit};
-    instructionTable[0xA8] = {&CPU::TAY, &CPU::Implicit};
-    instructionTable[0xBA] = {&CPU::TSX, &CPU::Implicit};
-    instructionTable[0x8A] = {&CPU::TXA, &CPU::Implicit};
-    instructionTable[0x9A] = {&CPU::TXS, &CPU::Implicit};
-    instructionTable[0x98] = {&CPU::TYA, &CPU::Implicit};
-
-    // Add instructions
-    instructionTable[0x4C] = {&CPU::JMP, &CPU::Absolute};
-    instructionTable[0x6C] = {&CPU::JMP, &CPU::IndirectJMP};
-    instructionTable[0x20] = {&CPU::JSR, &CPU::Absolute};
-    instructionTable[0x60] = {&CPU::RTS, &CPU::Implicit};
-    instructionTable[0x00] = {&CPU::BRK, &CPU::Implicit};
-    instructionTable[0x40] = {&CPU::RTI, &CPU::Implicit};
-    instructionTable[0x48] = {&CPU::PHA, &CPU::Implicit};
-    instructionTable[0x68] = {&CPU::PLA, &CPU::Implicit};
-    instructionTable[0x08] = {&CPU::PHP, &CPU::Implicit};
-    instructionTable[0x28] = {&CPU::PLP, &CPU::Implicit};
-    instructionTable[0x58] = {&CPU::CLI, &CPU::Implicit};
-    instructionTable[0x78] = {&CPU::SEI, &CPU::Implicit};
-    instructionTable[0xF0] = {&CPU::BEQ, &CPU::Relative};
-    instructionTable[0xD0] = {&CPU::BNE, &CPU::Relative};
-    instructionTable[0x90] = {&CPU::BCC, &CPU::Relative};
-    instructionTable[0xB0] = {&CPU::BCS, &CPU::Relative};
-    instructionTable[0x30] = {&CPU::BMI, &CPU::Relative};
-    instructionTable[0x10] = {&CPU::BPL, &CPU::Relative};
-    instructionTable[0x50] = {&CPU::BVC, &CPU::Relative};
-    instructionTable[0x70] = {&CPU::BVS, &CPU::Relative};
-    instructionTable[0x18] = {&CPU::CLC, &CPU::Implicit};
-    instructionTable[0x38] = {&CPU::SEC, &CPU::Implicit};
-    instructionTable[0x0A] = {&CPU::ASL, &CPU::Accumulator};
-    instructionTable[0x06] = {&CPU::ASL, &CPU::ZeroPage};
-    instructionTable[0x16] = {&CPU::ASL, &CPU::ZeroPageX};
-    instructionTable[0x0E] = {&CPU::ASL, &CPU::Absolute};
-    instructionTable[0x1E] = {&CPU::ASL, &CPU::AbsoluteX};
-    instructionTable[0x4A] = {&CPU::LSR, &CPU::Accumulator};
-    instructionTable[0x46] = {&CPU::LSR, &CPU::ZeroPage};
-    instructionTable[0x56] = {&CPU::LSR, &CPU::ZeroPageX};
-    instructionTable[0x4E] = {&CPU::LSR, &CPU::Absolute};
-    instructionTable[0x5E] = {&CPU::LSR, &CPU::AbsoluteX};
-    instructionTable[0x2A] = {&CPU::ROL, &CPU::Accumulator};
-    instructionTable[0x26] = {&CPU::ROL, &CPU::ZeroPage};
-    instructionTable[0x36] = {&CPU::ROL, &CPU::ZeroPageX};
-    instructionTable[0x2E] = {&CPU::ROL, &CPU::Absolute};
-    instructionTable[0x3E] = {&CPU::ROL, &CPU::AbsoluteX};
-    instructionTable[0x6A] = {&CPU::ROR, &CPU::Accumulator};
-    instructionTable[0x66] = {&CPU::ROR, &CPU::ZeroPage};
-    instructionTable[0x76] = {&CPU::ROR, &CPU::ZeroPageX};
-    instructionTable[0x6E] = {&CPU::ROR, &CPU::Absolute};
-    instructionTable[0x7E] = {&CPU::ROR, &CPU::AbsoluteX};
-    instructionTable[0xC9] = {&CPU::CMP, &CPU::Immediate};
-    instructionTable[0xC5] = {&CPU::CMP, &CPU::ZeroPage};
-    instructionTable[0xD5] = {&CPU::CMP, &CPU::ZeroPageX};
-    instructionTable[0xCD] = {&CPU::CMP, &CPU::Absolute};
-    instructionTable[0xDD] = {&CPU::CMP, &CPU::AbsoluteX};
-    instructionTable[0xD9] = {&CPU::CMP, &CPU::AbsoluteY};
-    instructionTable[0xC1] = {&CPU::CMP, &CPU::IndirectX};
-    instructionTable[0xD1] = {&CPU::CMP, &CPU::IndirectY};
-    instructionTable[0xE0] = {&CPU::CPX, &CPU::Immediate};
-    instructionTable[0xE4] = {&CPU::CPX, &CPU::ZeroPage};
-    instructionTable[0xEC] = {&CPU::CPX, &CPU::Absolute};
-    instructionTable[0xC0] = {&CPU::CPY, &CPU::Immediate};
-    instructionTable[0xC4] = {&CPU::CPY, &CPU::ZeroPage};
-    instructionTable[0xCC] = {&CPU::CPY, &CPU::Absolute};
-    instructionTable[0xEA] = {&CPU::NOP, &CPU::Implicit};
-    instructionTable[0xD8] = {&CPU::CLD, &CPU::Implicit};
-    instructionTable[0xF8] = {&CPU::SED, &CPU::Implicit};
-    instructionTable[0xB8] = {&CPU::CLV, &CPU::Implicit};
-    instructionTable[0x69] = {&CPU::ADC, &CPU::Immediate};
-    instructionTable[0x65] = {&CPU::ADC, &CPU::ZeroPage};
-    instructionTable[0x75] = {&CPU::ADC, &CPU::ZeroPageX};
-    instructionTable[0x6D] = {&CPU::ADC, &CPU::Absolute};
-    instructionTable[0x7D] = {&CPU::ADC, &CPU::AbsoluteX};
-    instructionTable[0x79] = {&CPU::ADC, &CPU::AbsoluteY};
-    instructionTable[0x61] = {&CPU::ADC, &CPU::IndirectX};
-    instructionTable[0x71] = {&CPU::ADC, &CPU::IndirectY};
-    instructionTable[0xE9] = {&CPU::SBC, &CPU::Immediate};
-    instructionTable[0xE5] = {&CPU::SBC, &CPU::ZeroPage};
-    instructionTable[0xF5] = {&CPU::SBC, &CPU::ZeroPageX};
-    instructionTable[0xED] = {&CPU::SBC, &CPU::Absolute};
-    instructionTable[0xFD] = {&CPU::SBC, &CPU::AbsoluteX};
-    instructionTable[0xF9] = {&CPU::SBC, &CPU::AbsoluteY};
-    instructionTable[0xE1] = {&CPU::SBC, &CPU::IndirectX};
-    instructionTable[0xF1] = {&CPU::SBC, &CPU::IndirectY};
-    instructionTable[0x24] = {&CPU::BIT, &CPU::ZeroPage};
-    instructionTable[0x2C] = {&CPU::BIT, &CPU::Absolute};
-    instructionTable[0x29] = {&CPU::AND, &CPU::Immediate};
-    instructionTable[0x25] = {&CPU::AND, &CPU::ZeroPage};
-    instructionTable[0x35] = {&CPU::AND, &CPU::ZeroPageX};
-    instructionTable[0x2D] = {&CPU::AND, &CPU::Absolute};
-    instructionTable[0x3D] = {&CPU::AND, &CPU::AbsoluteX};
-    instructionTable[0x39] = {&CPU::AND, &CPU::AbsoluteY};
-    instructionTable[0x21] = {&CPU::AND, &CPU::IndirectX};
-    instructionTable[0x31] = {&CPU::AND, &CPU::IndirectY};
-    instructionTable[0x09] = {&CPU::ORA, &CPU::Immediate};
-    instructionTable[0x05] = {&CPU::ORA, &CPU::ZeroPage};
-    instructionTable[0x15] = {&CPU::ORA, &CPU::ZeroPageX};
-    instructionTable[0x0D] = {&CPU::ORA, &CPU::Absolute};
-    instructionTable[0x1D] = {&CPU::ORA, &CPU::AbsoluteX};
-    instructionTable[0x19] = {&CPU::ORA, &CPU::AbsoluteY};
-    instructionTable[0x01] = {&CPU::ORA, &CPU::IndirectX};
-    instructionTable[0x11] = {&CPU::ORA, &CPU::IndirectY};
-    instructionTable[0x49] = {&CPU::EOR, &CPU::Immediate};
-    instructionTable[0x45] = {&CPU::EOR, &CPU::ZeroPage};
-    instructionTable[0x55] = {&CPU::EOR, &CPU::ZeroPageX};
-    instructionTable[0x4D] = {&CPU::EOR, &CPU::Absolute};
-    instructionTable[0x5D] = {&CPU::EOR, &CPU::AbsoluteX};
-    instructionTable[0x59] = {&CPU::EOR, &CPU::AbsoluteY};
-    instructionTable[0x41] = {&CPU::EOR, &CPU::IndirectX};
-    instructionTable[0x51] = {&CPU::EOR, &CPU::IndirectY};
-    instructionTable[0xC8] = {&CPU::INY, &CPU::Implicit};
-    instructionTable[0xE8] = {&CPU::INX, &CPU::Implicit};
-    instructionTable[0x88] = {&CPU::DEY, &CPU::Implicit};
-    instructionTable[0xCA] = {&CPU::DEX, &CPU::Implicit};
-    instructionTable[0xE6] = {&CPU::INC, &CPU::ZeroPage};
-    instructionTable[0xF6] = {&CPU::INC, &CPU::ZeroPageX};
-    instructionTable[0xEE] = {&CPU::INC, &CPU::Absolute};
-    instructionTable[0xFE] = {&CPU::INC, &CPU::AbsoluteX};
-    instructionTable[0xC6] = {&CPU::DEC, &CPU::ZeroPage};
-    instructionTable[0xD6] = {&CPU::DEC, &CPU::ZeroPageX};
-    instructionTable[0xCE] = {&CPU::DEC, &CPU::Absolute};
-    instructionTable[0xDE] = {&CPU::DEC, &CPU::AbsoluteX};
-
-    // Unofficial Opcodes
-    // SLO
-    instructionTable[0x07] = {&CPU::SLO, &CPU::ZeroPage};
-    instructionTable[0x17] = {&CPU::SLO, &CPU::ZeroPageX};
-    instructionTable[0x03] = {&CPU::SLO, &CPU::IndirectX};
-    instructionTable[0x13] = {&CPU::SLO, &CPU::IndirectY};
-    instructionTable[0x0F] = {&CPU::SLO, &CPU::Absolute};
-    instructionTable[0x1F] = {&CPU::SLO, &CPU::AbsoluteX};
-    instructionTable[0x1B] = {&CPU::SLO, &CPU::AbsoluteY};
-
-    // RLA
-    instructionTable[0x27] = {&CPU::RLA, &CPU::ZeroPage};
-    instructionTable[0x37] = {&CPU::RLA, &CPU::ZeroPageX};
-    instructionTable[0x23] = {&CPU::RLA, &CPU::IndirectX};
-    instructionTable[0x33] = {&CPU::RLA, &CPU::IndirectY};
-    instructionTable[0x2F] = {&CPU::RLA, &CPU::Absolute};
-    instructionTable[0x3F] = {&CPU::RLA, &CPU::AbsoluteX};
-    instructionTable[0x3B] = {&CPU::RLA, &CPU::AbsoluteY};
-
-    // SRE
-    instructionTable[0x47] = {&CPU::SRE, &CPU::ZeroPage};
-    instructionTable[0x57] = {&CPU::SRE, &CPU::ZeroPageX};
-    instructionTable[0x43] = {&CPU::SRE, &CPU::IndirectX};
-    instructionTable[0x53] = {&CPU::SRE, &CPU::IndirectY};
-    instructionTable[0x4F] = {&CPU::SRE, &CPU::Absolute};
-    instructionTable[0x5F] = {&CPU::SRE, &CPU::AbsoluteX};
-    instructionTable[0x5B] = {&CPU::SRE, &CPU::AbsoluteY};
-
-    // RRA
-    instructionTable[0x67] = {&CPU::RRA, &CPU::ZeroPage};
-    instructionTable[0x77] = {&CPU::RRA, &CPU::ZeroPageX};
-    instructionTable[0x63] = {&CPU::RRA, &CPU::IndirectX};
-    instructionTable[0x73] = {&CPU::RRA, &CPU::IndirectY};
-    instructionTable[0x6F] = {&CPU::RRA, &CPU::Absolute};
-    instructionTable[0x7F] = {&CPU::RRA, &CPU::AbsoluteX};
-    instructionTable[0x7B] = {&CPU::RRA, &CPU::AbsoluteY};
-
-    // SAX
-    instructionTable[0x87] = {&CPU::SAX, &CPU::ZeroPage};
-    instructionTable[0x97] = {&CPU::SAX, &CPU::ZeroPageY};
-    instructionTable[0x83] = {&CPU::SAX, &CPU::IndirectX};
-    instructionTable[0x8F] = {&CPU::SAX, &CPU::Absolute};
-
-    // LAX
-    instructionTable[0xA7] = {&CPU::LAX, &CPU::ZeroPage};
-    instructionTable[0xB7] = {&CPU::LAX, &CPU::ZeroPageY};
-    instructionTable[0xA3] = {&CPU::LAX, &CPU::IndirectX};
-    instructionTable[0xB3] = {&CPU::LAX, &CPU::IndirectY};
-    instructionTable[0xAF] = {&CPU::LAX, &CPU::Absolute};
-    instructionTable[0xBF] = {&CPU::LAX, &CPU::AbsoluteY};
-
-    // DCP
-    instructionTable[0xC7] = {&CPU::DCP, &CPU::ZeroPage};
-    instructionTable[0xD7] = {&CPU::DCP, &CPU::ZeroPageX};
-    instructionTable[0xC3] = {&CPU::DCP, &CPU::IndirectX};
-    instructionTable[0xD3] = {&CPU::DCP, &CPU::IndirectY};
-    instructionTable[0xCF] = {&CPU::DCP, &CPU::Absolute};
-    instructionTable[0xDF] = {&CPU::DCP, &CPU::AbsoluteX};
-    instructionTable[0xDB] = {&CPU::DCP, &CPU::AbsoluteY};
-
-    // ISC
-    instructionTable[0xE7] = {&CPU::ISC, &CPU::ZeroPage};
-    instructionTable[0xF7] = {&CPU::ISC, &CPU::ZeroPageX};
-    instructionTable[0xE3] = {&CPU::ISC, &CPU::IndirectX};
-    instructionTable[0xF3] = {&CPU::ISC, &CPU::IndirectY};
-    instructionTable[0xEF] = {&CPU::ISC, &CPU::Absolute};
-    instructionTable[0xFF] = {&CPU::ISC, &CPU::AbsoluteX};
-    instructionTable[0xFB] = {&CPU::ISC, &CPU::AbsoluteY};
-
-    // ANC
-    instructionTable[0x0B] = {&CPU::ANC, &CPU::Immediate};
-    instructionTable[0x2B] = {&CPU::ANC, &CPU::Immediate};
-
-    // ALR
-    instructionTable[0x4B] = {&CPU::ALR, &CPU::Immediate};
-
-    // ARR
-    instructionTable[0x6B] = {&CPU::ARR, &CPU::Immediate};
-
-    // AXS
-    instructionTable[0xCB] = {&CPU::AXS, &CPU::Immediate};
-
-    // SBC Unofficial
-    instructionTable[0xEB] = {&CPU::SBC, &CPU::Immediate};
-
-    // NOP
-    instructionTable[0x04] = {&CPU::NOP, &CPU::ZeroPage};
-    instructionTable[0x44] = {&CPU::NOP, &CPU::ZeroPageY};
-    instructionTable[0x64] = {&CPU::NOP, &CPU::ZeroPageX};
-    instructionTable[0x0C] = {&CPU::NOP, &CPU::Absolute};
-    instructionTable[0x14] = {&CPU::NOP, &CPU::IndirectX};
-    instructionTable[0x34] = {&CPU::NOP, &CPU::IndirectX};
-    instructionTable[0x54] = {&CPU::NOP, &CPU::IndirectX};
-    instructionTable[0x74] = {&CPU::NOP, &CPU::IndirectX};
-    instructionTable[0xD4] = {&CPU::NOP, &CPU::IndirectX};
-    instructionTable[0xF4] = {&CPU::NOP, &CPU::IndirectX};
-    instructionTable[0x1A] = {&CPU::NOP, &CPU::Implicit};
-    instructionTable[0x3A] = {&CPU::NOP, &CPU::Implicit};
-    instructionTable[0x5A] = {&CPU::NOP, &CPU::Implicit};
-    instructionTable[0x7A] = {&CPU::NOP, &CPU::Implicit};
-    instructionTable[0xDA] = {&CPU::NOP, &CPU::Implicit};
-    instructionTable[0xFA] = {&CPU::NOP, &CPU::Implicit};
-    instructionTable[0x80] = {&CPU::NOP, &CPU::IndirectX};
-    instructionTable[0x1C] = {&CPU::NOP, &CPU::Absolute};
-    instructionTable[0x3C] = {&CPU::NOP, &CPU::Absolute};
-    instructionTable[0x3C] = {&CPU::NOP, &CPU::Absolute};
-    instructionTable[0x5C] = {&CPU::NOP, &CPU::Absolute};
-    instructionTable[0x7C] = {&CPU::NOP, &CPU::Absolute};
-    instructionTable[0xDC] = {&CPU::NOP, &CPU::Absolute};
-    instructionTable[0xFC] = {&CPU::NOP, &CPU::Absolute};
+        if (OPCODE_TABLE[i].valid) {
+            table[i] = {operationFunction(OPCODE_TABLE[i].op), modeFunction(OPCODE_TABLE[i].mode)};
+        } else {
+            table[i] = {nullptr, nullptr};
+        }
+    }
+    return table;
+}
+
+constexpr std::array<CPU::Instruction, 256> CPU::instructionTable = makeInstructionTable();
+
+// ---------------------------------------------------------------------------- //
+// ---------------------------- TEMPLATED HANDLERS ---------------------------- //
+// ---------------------------------------------------------------------------- //
+
+template<AddrMode M>
+CPU::AddressResult CPU::address() {
+    return (this->*modeFunction(M))();
+}
+
+template<Op O>
+int CPU::operate(uint16_t address) {
+    return (this->*operationFunction(O))(address);
+}
+
+// One instruction specialised for its (addressing mode, operation) pair. Both member
+// pointers are compile-time constants here, so the calls inline into a single handler.
+// Returns the cycles charged.
+template<AddrMode M, Op O>
+int CPU::exec() {
+    AddressResult res = address<M>();
+    int instrCycles = operate<O>(res.address);
+
+    int total = res.cycles;
+    if (res.additionalCycles) {
+        total += instrCycles;
+    }
+    cycles += total;
+    return total;
+}
+
+// ---------------------------------------------------------------------------- //
+// ------------------------------ FUSED DISPATCH ------------------------------ //
+// ---------------------------------------------------------------------------- //
+
+// Dense switch over the opcode list, each case being the exec<> specialisation for that
+// opcode, so there is no member-function-pointer call or AddressResult return at runtime.
+#if defined(__GNUC__)
+__attribute__((flatten))
+#endif
+void CPU::dispatch(uint8_t opcode) {
+    switch (opcode) {
+#define X(opcode, op, mode) case opcode: exec<AddrMode::mode, Op::op>(); break;
+        CPU_OPCODES(X)
+#undef X
+        default:
+            // Unsupported opcode, treat as a 2 cycle NOP instead of calling a null handler
+            std::cout << "Error: Invalid opcode 0x" << std::hex << static_cast<int>(opcode) << "\n";
+            cycles += 2;
+            break;
+    }
+}
+
+// ---------------------------------------------------------------------------- //
+// ---------------------------- PREDECODE CACHE ------------------------------- //
+// ---------------------------------------------------------------------------- //
+
+// Addressing modes with the operand bytes supplied by the cache instead of read from PC.
+// Each branch mirrors the matching mode function below, including its extra bus reads
+// and PC updates, so both paths charge identical cycles and leave identical state.
+template<AddrMode M>
+CPU::AddressResult CPU::decodedAddress(uint16_t operand) {
+    constexpr AddrModeInfo info = modeInfo(M);
+    uint8_t lo = operand & 0xFF;
+    uint8_t hi = operand >> 8;
+    uint16_t addr = 0xFFFF;
+    int cycles = info.cycles;
+
+    if constexpr (M == AddrMode::Immediate) {
+        addr = PC++;
+    } else if constexpr (M == AddrMode::Relative || M == AddrMode::ZeroPage) {
+        addr = lo;
+        PC++;
+    } else if constexpr (M == AddrMode::ZeroPageX) {
+        addr = (lo + X) & 0xFF;
+        PC++;
+    } else if constexpr (M == AddrMode::ZeroPageY) {
+        addr = (lo + Y) & 0xFF;
+        PC++;
+    } else if constexpr (M == AddrMode::Absolute) {
+        addr = operand;
+        PC += 2;
+    } else if constexpr (M == AddrMode::AbsoluteX || M == AddrMode::AbsoluteY) {
+        addr = operand + (M == AddrMode::AbsoluteX ? X : Y);
+        if ((addr & 0xFF00) != (hi << 8)) {
+            cycles += info.pageCrossPenalty;
+        }
+        PC += 2;
+    } else if constexpr (M == AddrMode::Indirect) {
+        addr = readBus(operand) | readBus((operand + 1) & 0xFFFF) << 8;
+        PC += 2;
+    } else if constexpr (M == AddrMode::IndirectX) {
+        uint16_t ptrAddr = (lo + X) & 0xFF;
+        PC++;
+        uint16_t ptrLo = readBus(ptrAddr);
+        uint16_t ptrHi = readBus(ptrAddr == 0xFF ? 0x0000 : ptrAddr + 1) << 8;
+        addr = ptrLo | ptrHi;
+    } else if constexpr (M == AddrMode::IndirectY) {
+        uint16_t ptrAddr = lo;
+        PC++;
+        uint16_t ptrLo = readBus(ptrAddr);
+        uint16_t ptrHi = readBus(ptrAddr == 0xFF ? 0x0000 : ptrAddr + 1) << 8;
+        addr = (ptrLo | ptrHi) + Y;
+        // Page check re-reads ptrAddr + 1 unwrapped, same as IndirectY()
+        if ((addr & 0xFF00) != (readBus(ptrAddr + 1) << 8)) {
+            cycles += info.pageCrossPenalty;
+        }
+    } else if constexpr (M == AddrMode::IndirectJMP) {
+        PC += 2;
+        uint16_t ptrHi = lo == 0xFF ? readBus(operand & 0xFF00) : readBus(operand + 1);
+        addr = (ptrHi << 8) | readBus(operand);
+    }
+
+    return {addr, cycles, info.addsOpCycles};
+}
+
+// exec<> for a predecoded instruction, PC already past the opcode
+template<AddrMode M, Op O>
+int CPU::execDecoded(CPU& cpu, uint16_t operand) {
+    AddressResult res = cpu.decodedAddress<M>(operand);
+    int instrCycles = cpu.operate<O>(res.address);
+
+    int total = res.cycles;
+    if (res.additionalCycles) {
+        total += instrCycles;
+    }
+    cpu.cycles += total;
+    return total;
+}
+
+constexpr std::array<CPU::DecodedHandler, 256> makeDecodedHandlers() {
+    std::array<CPU::DecodedHandler, 256> table{};
+#define X(opcode, op, mode) table[opcode] = &CPU::execDecoded<AddrMode::mode, Op::op>;
+    CPU_OPCODES(X)
+#undef X
+    return table;
+}
+
+constexpr std::array<CPU::DecodedHandler, 256> CPU::decodedHandlers = makeDecodedHandlers();
+
+// Cache slot for an instruction at address, -1 outside internal RAM and PRG-ROM
+static int decodeSlot(uint16_t address) {
+    if (address <= 0x1FFF) {
+        return address & 0x07FF;
+    }
+    if (address >= 0x8000) {
+        return CPU::DECODE_RAM_SLOTS + (address - 0x8000);
+    }
+    return -1;
+}
+
+// Returns the decoded instruction at address, decoding it on a miss. Returns nullptr when
+// the instruction can't be cached (I/O or cartridge RAM, operand leaving the region,
+// invalid opcode) and the plain interpreter has to run it.
+CPU::DecodedInstruction* CPU::decodedAt(uint16_t address) {
+    int slot = decodeSlot(address);
+    if (slot < 0) {
+        return nullptr;
+    }
+    if (decodeCache.empty()) {
+        decodeCache.resize(DECODE_RAM_SLOTS + DECODE_ROM_SLOTS);
+    }
+
+    DecodedInstruction& entry = decodeCache[slot];
+    if (entry.handler) {
+        return &entry;
+    }
+
+    uint8_t opcode = readBus(address);
+    const OpcodeInfo& info = OPCODE_TABLE[opcode];
+    if (!info.valid) {
+        return nullptr;
+    }
+    uint16_t last = address + info.bytes - 1;
+    if (address <= 0x1FFF ? last > 0x1FFF : last < 0x8000) {
+        return nullptr;
+    }
+
+    entry.operand = 0;
+    if (info.bytes > 1) entry.operand = readBus(address + 1);
+    if (info.bytes > 2) entry.operand |= readBus(address + 2) << 8;
+    entry.opcode = opcode;
+    entry.handler = decodedHandlers[opcode];
+
+    // Writes to these pages now have to invalidate
+    if (address <= 0x1FFF) {
+        for (int i = 0; i < info.bytes; i++) {
+            ramCodePages |= 1 << (((address + i) & 0x07FF) >> 8);
+        }
+    }
+    return &entry;
+}
+
+// Drops every instruction overlapping the byte at address (it may be the opcode or one
+// of up to two operand bytes). PRG writes also hit the other 16KB half, as NROM-128
+// mirrors one bank into both.
+void CPU::invalidateDecodedAt(uint16_t address) {
+    if (address >= 0x8000 && dynarec) {
+        dynarec->flush();   // Blocks embed PRG bytes
+    }
+    if (decodeCache.empty()) {
+        return;
+    }
+    if (address <= 0x1FFF) {
+        for (int i = 0; i < 3; i++) {
+            decodeCache[(address - i) & 0x07FF].handler = nullptr;
+        }
+        return;
+    }
+    for (uint16_t mirror : {address, static_cast<uint16_t>(address ^ 0x4000)}) {
+        for (int i = 0; i < 3; i++) {
+            if (mirror - i >= 0x8000) {
+                decodeCache[decodeSlot(mirror - i)].handler = nullptr;
+            }
+        }
+    }
+}
+
+// Drops everything decoded in [start, end], for mappers switching the PRG bank there
+void CPU::invalidateDecodedRange(uint16_t start, uint16_t end) {
+    if (dynarec) {
+        dynarec->flush();
+    }
+    if (decodeCache.empty()) {
+        return;
+    }
+    // Instructions starting up to two bytes earlier run into the range
+    for (int address = start - 2; address <= end; address++) {
+        int slot = address >= 0 ? decodeSlot(address) : -1;
+        if (slot >= 0) {
+            decodeCache[slot].handler = nullptr;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------- //
+// ---------------------------- IDLE LOOP SKIPPING ---------------------------- //
+// ---------------------------------------------------------------------------- //
+
+// Checks the loop starting at head: up to 8 instructions closed by a branch or JMP back to
+// head, no writes or stack use, reads only from RAM, ROM or PPUSTATUS (whose only side
+// effects, clearing vblank and the w latch, repeat identically), and no way out other than
+// falling through the closing branch.
+bool CPU::analyzeIdleLoop(uint16_t head) {
+    auto isMemory = [](uint16_t address) { return address <= 0x1FFF || address >= 0x8000; };
+
+    idleLoop.readsStatus = false;
+    idleLoop.maxCycles = 0;
+    int furthestTarget = head;
+    int pc = head;
+    for (int i = 0; i < 8; i++) {
+        // Check where the code is before reading it, a register read could change state
+        if (!isMemory(pc)) {
+            return false;
+        }
+        const OpcodeInfo& info = OPCODE_TABLE[readBus(pc)];
+        if (!info.valid || !isMemory(pc + info.bytes - 1)) {
+            return false;
+        }
+        uint16_t operand = 0;
+        if (info.bytes > 1) operand = readBus(pc + 1);
+        if (info.bytes > 2) operand |= readBus(pc + 2) << 8;
+
+        if (info.access == Access::Write || info.access == Access::ReadModifyWrite) {
+            return false;
+        }
+        switch (info.op) {
+            case Op::PHA: case Op::PHP: case Op::PLA: case Op::PLP:
+            case Op::JSR: case Op::RTS: case Op::RTI: case Op::BRK:
+                return false;
+            default:
+                break;
+        }
+        switch (info.mode) {
+            case AddrMode::Indirect: case AddrMode::IndirectJMP:
+            case AddrMode::IndirectX: case AddrMode::IndirectY:
+                return false;
+            case AddrMode::Absolute:
+                if (info.access == Access::Read && !isMemory(operand)) {
+                    if ((operand & 0xE007) != 0x2002) {
+                        return false;
+                    }
+                    idleLoop.readsStatus = true;
+                }
+                break;
+            case AddrMode::AbsoluteX: case AddrMode::AbsoluteY:
+                if (operand > 0x1F00 && operand < 0x8000) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
+        idleLoop.maxCycles += worstCaseCycles(info);
+
+        if (isBranch(info.op) || info.op == Op::JMP) {
+            int target = info.op == Op::JMP ? operand : (pc + 2 + static_cast<int8_t>(operand)) & 0xFFFF;
+            if (target == head) {
+                idleLoop.end = pc;
+                return furthestTarget <= pc;
+            }
+            if (info.op == Op::JMP || target < head) {
+                return false;
+            }
+            furthestTarget = std::max(furthestTarget, target);
+        }
+        pc += info.bytes;
+    }
+    return false;
+}
+
+// Called at each instruction boundary. Returns true if iterations of an idle loop were
+// charged to cycles in place of running the next instruction.
+bool CPU::skipIdleLoop() {
+    uint16_t from = lastInstructionPC;
+    lastInstructionPC = PC;
+    // Only interesting right after a short backward jump
+    if (PC > from || from - PC > 32) {
+        return false;
+    }
+
+    // Only loops polling PPUSTATUS need the PPU caught up to look at its flags
+    auto ppuStatus = [this]() -> uint8_t {
+        if (!idleLoop.readsStatus) {
+            return 0;
+        }
+        bus->syncPpu();
+        return bus->ppu.status.reg & 0xE0;
+    };
+    auto record = [this, &ppuStatus]() {
+        idleLoop.A = A; idleLoop.X = X; idleLoop.Y = Y; idleLoop.S = S; idleLoop.P = status();
+        idleLoop.status = ppuStatus();
+        idleLoop.clock = bus->cpuClockCounter;
+        idleLoop.interrupts = interruptCount;
+    };
+
+    if (PC != idleLoop.head) {
+        idleLoop.head = PC;
+        idleLoop.valid = analyzeIdleLoop(PC);
+        record();
+        return false;
+    }
+    if (!idleLoop.valid || from != idleLoop.end) {
+        record();
+        return false;
+    }
+
+    // One uninterrupted iteration that changed nothing, not even a flag it could have read
+    uint32_t length = bus->cpuClockCounter - idleLoop.clock;
+    bool unchanged = A == idleLoop.A && X == idleLoop.X && Y == idleLoop.Y && S == idleLoop.S &&
+                     status() == idleLoop.P && interruptCount == idleLoop.interrupts &&
+                     ppuStatus() == idleLoop.status;
+    record();
+    if (!unchanged || length == 0 || length > static_cast<uint32_t>(idleLoop.maxCycles)) {
+        return false;
+    }
+
+    // Master clock ticks until something the loop could notice may change. An NMI due
+    // this tick would interrupt the first iteration.
+    if (bus->ppu.nmi) {
+        return false;
+    }
+    uint32_t deadline = std::min({bus->ticksUntilDot(241, 1), bus->syncClock - bus->clockCounter,
+                                  bus->ticksUntilDmcFetch()});
+    if (idleLoop.readsStatus) {
+        // Sprite zero hit can land on any dot while both layers render
+        if (bus->ppu.mask.enable_background_rendering && bus->ppu.mask.enable_sprite_rendering &&
+            !bus->ppu.status.sprite_zerohit) {
+            return false;
+        }
+        deadline = std::min(deadline, bus->ticksUntilDot(-1, 1));   // Flags cleared
+    }
+
+    uint32_t iterations = deadline / (3 * length);
+    if (iterations == 0) {
+        return false;
+    }
+    cycles += iterations * length;
+    idleCyclesSkipped += iterations * length;
+    // Back at head once these run out, measure a fresh iteration from there
+    idleLoop.clock += iterations * length;
+    return true;
+}
+
+// Turns the recompiler on or off. It needs a connected bus and an x86-64 POSIX host,
+// elsewhere the interpreter keeps running everything.
+void CPU::enableDynarec(bool enable, bool differential) {
+    if (!enable || !bus || !Dynarec::supported()) {
+        dynarec.reset();
+        return;
+    }
+    if (!dynarec) {
+        dynarec = std::make_unique<Dynarec>(*this, *bus);
+    }
+    dynarec->differential = differential;
+}
+
+// Disassemble the instruction at address, e.g. "LDA $0200,X". Reads through the bus, so
+// only use it on RAM/ROM where reads have no side effects.
+std::string CPU::disassemble(uint16_t address) {
+    const OpcodeInfo& info = OPCODE_TABLE[readBus(address)];
+    uint8_t lo = info.bytes > 1 ? readBus(address + 1) : 0;
+    uint8_t hi = info.bytes > 2 ? readBus(address + 2) : 0;
+    uint16_t operand = (hi << 8) | lo;
+
+    char text[32];
+    switch (info.mode) {
+        case AddrMode::Implicit:    snprintf(text, sizeof(text), "%s", info.mnemonic); break;
+        case AddrMode::Accumulator: snprintf(text, sizeof(text), "%s A", info.mnemonic); break;
+        case AddrMode::Immediate:   snprintf(text, sizeof(text), "%s #$%02X", info.mnemonic, lo); break;
+        case AddrMode::Relative:    snprintf(text, sizeof(text), "%s $%04X", info.mnemonic,
+                                             static_cast<uint16_t>(address + 2 + static_cast<int8_t>(lo))); break;
+        case AddrMode::ZeroPage:    snprintf(text, sizeof(text), "%s $%02X", info.mnemonic, lo); break;
+        case AddrMode::ZeroPageX:   snprintf(text, sizeof(text), "%s $%02X,X", info.mnemonic, lo); break;
+        case AddrMode::ZeroPageY:   snprintf(text, sizeof(text), "%s $%02X,Y", info.mnemonic, lo); break;
+        case AddrMode::Absolute:    snprintf(text, sizeof(text), "%s $%04X", info.mnemonic, operand); break;
+        case AddrMode::AbsoluteX:   snprintf(text, sizeof(text), "%s $%04X,X", info.mnemonic, operand); break;
+        case AddrMode::AbsoluteY:   snprintf(text, sizeof(text), "%s $%04X,Y", info.mnemonic, operand); break;
+        case AddrMode::Indirect:
+        case AddrMode::IndirectJMP: snprintf(text, sizeof(text), "%s ($%04X)", info.mnemonic, operand); break;
+        case AddrMode::IndirectX:   snprintf(text, sizeof(text), "%s ($%02X,X)", info.mnemonic, lo); break;
+        case AddrMode::IndirectY:   snprintf(text, sizeof(text), "%s ($%02X),Y", info.mnemonic, lo); break;
+    }
+    return text;
 }
+
 // ---------------------------------------------------------------------------- //
 // ------------------------------- INSTRUCTIONS ------------------------------- //
 // ---------------------------------------------------------------------------- //
@@ -439,8 +693,7 @@ int CPU::LDA(uint16_t address) {
     uint8_t value = readBus(address);
     A = value;
 
-    setFlag(FLAGS::Z, A == 0);
-    setFlag(FLAGS::N, A & 0x80);
+    setNZ(A);
     return 0;
 }
 
@@ -448,8 +701,7 @@ int CPU::LDX(uint16_t address) {
     uint8_t value = readBus(address);
     X = value;
 
-    setFlag(FLAGS::Z, X == 0);
-    setFlag(FLAGS::N, X & 0x80);
+    setNZ(X);
     return 0;
 }
 
@@ -457,8 +709,7 @@ int CPU::LDY(uint16_t address) {
     uint8_t value = readBus(address);
     Y = value;
 
-    setFlag(FLAGS::Z, Y == 0);
-    setFlag(FLAGS::N, Y & 0x80);
+    setNZ(Y);
     return 0;
 }
 
@@ -481,32 +732,28 @@ int CPU::STY(uint16_t address) {
 int CPU::TAX(uint16_t) {
     X = A;
 
-    setFlag(FLAGS::Z, X == 0);
-    setFlag(FLAGS::N, X & 0x80);
+    setNZ(X);
     return 0;
 }
 
 int CPU::TAY(uint16_t) {
     Y = A;
 
-    setFlag(FLAGS::Z, Y == 0);
-    setFlag(FLAGS::N, Y & 0x80);
+    setNZ(Y);
     return 0;
 }
 
 int CPU::TSX(uint16_t) {
     X = S;
 
-    setFlag(FLAGS::Z, X == 0);
-    setFlag(FLAGS::N, X & 0x80);
+    setNZ(X);
     return 0;
 }
 
 int CPU::TXA(uint16_t) {
     A = X;
 
-    setFlag(FLAGS::Z, A == 0);
-    setFlag(FLAGS::N, A & 0x80);
+    setNZ(A);
     return 0;
 }
 
@@ -518,8 +765,7 @@ int CPU::TXS(uint16_t) {
 int CPU::TYA(uint16_t) {
     A = Y;
 
-    setFlag(FLAGS::Z, A == 0);
-    setFlag(FLAGS::N, A & 0x80);
+    setNZ(A);
     return 0;
 }
 
@@ -544,11 +790,8 @@ int CPU::ADC(uint16_t address) {
         setFlag(CPU::FLAGS::V, false);
     }
 
-    // Set Z flag if zero
-    setFlag(CPU::FLAGS::Z, trunc_result == 0);
-
-    // Set N flag if negative
-    setFlag(CPU::FLAGS::N, trunc_result & 0x80);
+    // Set Z and N flags from the result
+    setNZ(trunc_result);
 
     // Update A
     A = trunc_result;
@@ -564,9 +807,8 @@ int CPU::SBC(uint16_t address) {
     uint16_t temp_value = (uint16_t)A + result + (uint16_t)getFlag(C);
 
     setFlag(C, temp_value & 0xFF00);
-    setFlag(Z, ((temp_value & 0x00FF) == 0));
     setFlag(V, (temp_value ^ (uint16_t)A) & (temp_value ^ result) & 0x0080);
-    setFlag(N, temp_value & 0x0080);
+    setNZ(temp_value & 0x00FF);
     A = temp_value & 0x00FF;
 
     return 0;
@@ -583,22 +825,19 @@ int CPU::BIT(uint16_t address) {
 
 int CPU::AND(uint16_t address) {
     A = A & readBus(address);
-    setFlag(Z, A == 0x00);
-    setFlag(N, A & (1 << 7));
+    setNZ(A);
     return 0;
 }
 
 int CPU::ORA(uint16_t address) {
     A = A | readBus(address);
-    setFlag(Z, A == 0x00);
-    setFlag(N, A & (1 << 7));
+    setNZ(A);
     return 0;
 }
 
 int CPU::EOR(uint16_t address) {
     A = A ^ readBus(address);
-    setFlag(Z, A == 0x00);
-    setFlag(N, A & (1 << 7));
+    setNZ(A);
     return 0;
 }
 
@@ -608,8 +847,7 @@ int CPU::INY(uint16_t address) {
     }
 
     Y++;
-    setFlag(Z, Y == 0x00);
-    setFlag(N, Y & (1 << 7));
+    setNZ(Y);
     return 0;
 }
 
@@ -619,8 +857,7 @@ int CPU::INX(uint16_t address) {
     }
 
     X++;
-    setFlag(Z, X == 0x00);
-    setFlag(N, X & (1 << 7));
+    setNZ(X);
     return 0;
 }
 
@@ -630,8 +867,7 @@ int CPU::DEY(uint16_t address) {
     }
 
     Y--;
-    setFlag(Z, Y == 0x00);
-    setFlag(N, Y & (1 << 7));
+    setNZ(Y);
     return 0;
 }
 
@@ -641,8 +877,7 @@ int CPU::DEX(uint16_t address) {
     }
 
     X--;
-    setFlag(Z, X == 0x00);
-    setFlag(N, X & (1 << 7));
+    setNZ(X);
     return 0;
 }
 
@@ -650,8 +885,7 @@ int CPU::INC(uint16_t address) {
     uint8_t value = readBus(address);
     value ++;
     writeBus(address, value);
-    setFlag(Z, value == 0x00);
-    setFlag(N, value & (1 << 7));
+    setNZ(value);
     // Requires 2 additional cycles
     return 2;
 }
@@ -660,8 +894,7 @@ int CPU::DEC(uint16_t address) {
     uint8_t value = readBus(address);
     value --;
     writeBus(address, value);
-    setFlag(Z, value == 0x00);
-    setFlag(N, value & (1 << 7));
+    setNZ(value);
     // Requires 2 additional cycles
     return 2;
 }
@@ -714,7 +947,7 @@ int CPU::BRK(uint16_t address) {
     stack_push16(PC);
 
     setFlag(B, true);
-    stack_push(P);
+    stack_push(status());
 
     setFlag(I, true);
     setFlag(B, false);
@@ -736,7 +969,7 @@ int CPU::RTI(uint16_t address) {
 
     // Pop stack and set to flags
     uint8_t flags = stack_pop();
-    P = flags;
+    setStatus(flags);
     setFlag(B, false);
     setFlag(U, true);
 
@@ -769,8 +1002,7 @@ int CPU::PLA(uint16_t address) {
     }
 
     A = stack_pop();
-    setFlag(Z, A == 0);
-    setFlag(N, A & (1 << 7));
+    setNZ(A);
     // For some reason requires 2 additional cycles
     return 2;
 }
@@ -783,7 +1015,7 @@ int CPU::PHP(uint16_t address) {
 
     setFlag(B, true);
     setFlag(U, true);
-    stack_push(P);
+    stack_push(status());
     setFlag(B, false);
     // Also requires 1 additional cycle
     return 1;
@@ -795,7 +1027,7 @@ int CPU::PLP(uint16_t address) {
         throw std::runtime_error("PLP called without implied mode");
     }
 
-    P = stack_pop();
+    setStatus(stack_pop());
     setFlag(U, true);
     setFlag(B, false);
     // Also requires 2 additional cycles
@@ -1004,11 +1236,9 @@ int CPU::ASL(uint16_t address) {
     // MSB = Most Significant Bit
     int value_msb = (value >> 7) & 1;
     uint8_t shifted_value = value << 1;
-    int shifted_value_msb = (shifted_value >> 7) & 1;
     // C, N, Z flags are affected
     setFlag(C, value_msb);
-    setFlag(N, shifted_value_msb);
-    setFlag(Z, shifted_value == 0);
+    setNZ(shifted_value);
     if (address == 0xFFFF) {
         A = shifted_value;
     } else {
@@ -1031,10 +1261,8 @@ int CPU::LSR(uint16_t address) {
     // LSB = Least Significant Bit
     int value_lsb = value & 1;
     uint8_t shifted_value = value >> 1;
-    int shifted_value_msb = (shifted_value >> 7) & 1;
     setFlag(C, value_lsb);
-    setFlag(N, shifted_value_msb);
-    setFlag(Z, shifted_value == 0);
+    setNZ(shifted_value);
     if (address == 0xFFFF) {
         A = shifted_value;
     } else {
@@ -1055,14 +1283,12 @@ int CPU::ROL(uint16_t address) {
     }
     int value_msb = (value >> 7) & 1;
     uint8_t shifted_value = value << 1;
-    int shifted_value_msb = (shifted_value >> 7) & 1;
     // The value held in the Carry flag is shifted into the LSB of the new value
     if (getFlag(C) == 1) {
         shifted_value |= 1;
     }
     setFlag(C, value_msb);
-    setFlag(N, shifted_value_msb);
-    setFlag(Z, shifted_value == 0);
+    setNZ(shifted_value);
     if (address == 0xFFFF) {
         A = shifted_value;
     } else {
@@ -1088,10 +1314,8 @@ int CPU::ROR(uint16_t address) {
     if (getFlag(C) == 1) {
         shifted_value |= 0x80;
     }
-    int shifted_value_msb = (shifted_value & 0x80);
     setFlag(C, value_lsb);
-    setFlag(N, shifted_value_msb);
-    setFlag(Z, shifted_value == 0);
+    setNZ(shifted_value);
     if (address == 0xFFFF) {
         A = shifted_value;
     } else {
@@ -1108,10 +1332,8 @@ int CPU::ROR(uint16_t address) {
 int CPU::CMP(uint16_t address) {
     uint8_t value = readBus(address);
     uint8_t result = A - value;
-    int result_msb = (result >> 7) & 1;
     setFlag(C, A >= value);
-    setFlag(N, result_msb);
-    setFlag(Z, A == value);
+    setNZ(result);
     return 0;
 }
 
@@ -1119,10 +1341,8 @@ int CPU::CMP(uint16_t address) {
 int CPU::CPX(uint16_t address) {
     uint8_t value = readBus(address);
     uint8_t result = X - value;
-    int result_msb = (result >> 7) & 1;
     setFlag(C, X >= value);
-    setFlag(N, result_msb);
-    setFlag(Z, X == value);
+    setNZ(result);
     return 0;
 }
 
@@ -1130,10 +1350,8 @@ int CPU::CPX(uint16_t address) {
 int CPU::CPY(uint16_t address) {
     uint8_t value = readBus(address);
     uint8_t result = Y - value;
-    int result_msb = (result >> 7) & 1;
     setFlag(C, Y >= value);
-    setFlag(N, result_msb);
-    setFlag(Z, Y == value);
+    setNZ(result);
     return 0;
 }
 
@@ -1234,8 +1452,7 @@ int CPU::ISC(uint16_t address) {
 // AND then setting NZC flags
 int CPU::ANC(uint16_t address) {
     A = A & readBus(address);
-    setFlag(Z, A == 0x00);
-    setFlag(N, A & (1 << 7));
+    setNZ(A);
     setFlag(C, A & (1 << 7));
     return 0;
 }
@@ -1244,18 +1461,15 @@ int CPU::ANC(uint16_t address) {
 int CPU::ALR(uint16_t address) {
     // AND - Immediate
     A = A & readBus(address);
-    setFlag(Z, A == 0x00);
-    setFlag(N, A & (1 << 7));
+    setNZ(A);
 
     // LSR - Accumulator
     uint8_t value = A;
 
     int value_lsb = value & 1;
     uint8_t shifted_value = value >> 1;
-    int shifted_value_msb = (shifted_value >> 7) & 1;
     setFlag(C, value_lsb);
-    setFlag(N, shifted_value_msb);
-    setFlag(Z, shifted_value == 0);
+    setNZ(shifted_value);
 
     A = shifted_value;
     return 0;
@@ -1265,8 +1479,7 @@ int CPU::ALR(uint16_t address) {
 int CPU::ARR(uint16_t address) {
     // AND - Immediate
     A = A & readBus(address);
-    setFlag(Z, A == 0x00);
-    setFlag(N, A & (1 << 7));
+    setNZ(A);
 
     // ROR - Accumulator
     uint8_t value = A;
@@ -1276,13 +1489,11 @@ int CPU::ARR(uint16_t address) {
     if (getFlag(C) == 1) {
         shifted_value |= 0x80;
     }
-    int shifted_value_msb = (shifted_value >> 7) & 1;
     int bit_five = (shifted_value >> 5) & 1;
     int bit_six = (shifted_value >> 6) & 1;
 
     setFlag(C, bit_six);
-    setFlag(N, shifted_value_msb);
-    setFlag(Z, shifted_value == 0);
+    setNZ(shifted_value);
     setFlag(V, bit_six^bit_five);
 
     A = shifted_value;
@@ -1295,8 +1506,7 @@ int CPU::AXS(uint16_t address) {
     X = (A & X) - value;
 
     setFlag(C, 0);
-    setFlag(N, (X >> 7) & 1);
-    setFlag(Z, X == 0);
+    setNZ(X);
     return 0;
 }
 // -------------------------------------------------------------------------------- //
@@ -1306,9 +1516,9 @@ int CPU::AXS(uint16_t address) {
 // Address is implied, returning 0xFFFF as indicator
 CPU::AddressResult CPU::Implicit() {
     uint16_t address = 0xFFFF;
-    int cycles = 2;
+    int cycles = modeInfo(AddrMode::Implicit).cycles;
     // Set to true to allow for special cases
-    bool additionalCycles = true;
+    bool additionalCycles = modeInfo(AddrMode::Implicit).addsOpCycles;
 
     return {address, cycles, additionalCycles};
 }
@@ -1316,8 +1526,8 @@ CPU::AddressResult CPU::Implicit() {
 // Address is directly at the next PC
 CPU::AddressResult CPU::Immediate() {
     uint16_t address = PC++;
-    int cycles = 2;
-    bool additionalCycles = false;
+    int cycles = modeInfo(AddrMode::Immediate).cycles;
+    bool additionalCycles = modeInfo(AddrMode::Immediate).addsOpCycles;
 
     return {address, cycles, additionalCycles};
 }
@@ -1326,8 +1536,8 @@ CPU::AddressResult CPU::Immediate() {
 // Logic to be handled in instruction
 CPU::AddressResult CPU::Accumulator() {
     uint16_t address = 0xFFFF;
-    int cycles = 2;
-    bool additionalCycles = false;
+    int cycles = modeInfo(AddrMode::Accumulator).cycles;
+    bool additionalCycles = modeInfo(AddrMode::Accumulator).addsOpCycles;
 
     return {address, cycles, additionalCycles};
 }
@@ -1340,10 +1550,10 @@ CPU::AddressResult CPU::Relative() {
     // Return a uint16_t as forced, which will be converted back into
     // an int8_t in the branch instructions
     uint16_t addr = offset & 0xFF;
-    int cycles = 2;
+    int cycles = modeInfo(AddrMode::Relative).cycles;
     // Branch instructions will modify cycles based on
     // branch taken and page crossing
-    bool additionalCycles = true;
+    bool additionalCycles = modeInfo(AddrMode::Relative).addsOpCycles;
 
     return {addr, cycles, additionalCycles};
 }
@@ -1351,8 +1561,8 @@ CPU::AddressResult CPU::Relative() {
 // Return address from zero page memory
 CPU::AddressResult CPU::ZeroPage() {
     uint16_t address = readBus(PC++);
-    int cycles = 3;
-    bool additionalCycles = true;
+    int cycles = modeInfo(AddrMode::ZeroPage).cycles;
+    bool additionalCycles = modeInfo(AddrMode::ZeroPage).addsOpCycles;
 
     return {address, cycles, additionalCycles};
 }
@@ -1360,8 +1570,8 @@ CPU::AddressResult CPU::ZeroPage() {
 // Reuturn address + X from zero page memory, wrapped
 CPU::AddressResult CPU::ZeroPageX() {
     uint16_t address = readBus(PC++) + X & 0xFF;
-    int cycles = 4;
-    bool additionalCycles = true;
+    int cycles = modeInfo(AddrMode::ZeroPageX).cycles;
+    bool additionalCycles = modeInfo(AddrMode::ZeroPageX).addsOpCycles;
 
     return {address, cycles, additionalCycles};
 }
@@ -1369,8 +1579,8 @@ CPU::AddressResult CPU::ZeroPageX() {
 // Reuturn address + Y from zero page memory, wrapped
 CPU::AddressResult CPU::ZeroPageY() {
     uint16_t address = readBus(PC++) + Y & 0xFF;
-    int cycles = 4;
-    bool additionalCycles = true;
+    int cycles = modeInfo(AddrMode::ZeroPageY).cycles;
+    bool additionalCycles = modeInfo(AddrMode::ZeroPageY).addsOpCycles;
 
     return {address, cycles, additionalCycles};
 }
@@ -1379,8 +1589,8 @@ CPU::AddressResult CPU::ZeroPageY() {
 CPU::AddressResult CPU::Absolute() {
     uint16_t addr = readBus(PC) | readBus(PC + 1) << 8;
     PC += 2;
-    int cycles = 4;
-    bool additionalCycles = true;
+    int cycles = modeInfo(AddrMode::Absolute).cycles;
+    bool additionalCycles = modeInfo(AddrMode::Absolute).addsOpCycles;
 
     return {addr, cycles, additionalCycles};
 }
@@ -1389,12 +1599,12 @@ CPU::AddressResult CPU::Absolute() {
 CPU::AddressResult CPU::AbsoluteX() {
     uint16_t addr = readBus(PC) | readBus(PC + 1) << 8;
     addr += X;
-    int cycles = 4;
+    int cycles = modeInfo(AddrMode::AbsoluteX).cycles;
     // additionalCycles dependent on page boundary crossed
     if ((addr & 0xFF00) != (readBus(PC + 1) << 8)) {
-        cycles++;
+        cycles += modeInfo(AddrMode::AbsoluteX).pageCrossPenalty;
     }
-    bool additionalCycles = true;
+    bool additionalCycles = modeInfo(AddrMode::AbsoluteX).addsOpCycles;
     PC += 2;
 
     return {addr, cycles, additionalCycles};
@@ -1404,11 +1614,11 @@ CPU::AddressResult CPU::AbsoluteX() {
 CPU::AddressResult CPU::AbsoluteY() {
     uint16_t addr = readBus(PC) | readBus(PC + 1) << 8;
     addr += Y;
-    int cycles = 4;
+    int cycles = modeInfo(AddrMode::AbsoluteY).cycles;
     if ((addr & 0xFF00) != (readBus(PC + 1) << 8)) {
-        cycles++;
+        cycles += modeInfo(AddrMode::AbsoluteY).pageCrossPenalty;
     }
-    bool additionalCycles = true;
+    bool additionalCycles = modeInfo(AddrMode::AbsoluteY).addsOpCycles;
     PC += 2;
 
     return {addr, cycles, additionalCycles};
@@ -1421,8 +1631,8 @@ CPU::AddressResult CPU::Indirect() {
     // Find address referenced by pointer
     uint16_t addr = readBus(pointer) | readBus((pointer + 1) & 0xFFFF) << 8;
     PC += 2;
-    int cycles = 5;
-    bool additionalCycles = false;
+    int cycles = modeInfo(AddrMode::Indirect).cycles;
+    bool additionalCycles = modeInfo(AddrMode::Indirect).addsOpCycles;
 
     return {addr, cycles, additionalCycles};
 }
@@ -1440,8 +1650,8 @@ CPU::AddressResult CPU::IndirectX() {
     }
 
     uint16_t addr = lo | hi;
-    int cycles = 6;
-    bool additionalCycles = false;
+    int cycles = modeInfo(AddrMode::IndirectX).cycles;
+    bool additionalCycles = modeInfo(AddrMode::IndirectX).addsOpCycles;
 
     return {addr, cycles, additionalCycles};
 }
@@ -1459,12 +1669,12 @@ CPU::AddressResult CPU::IndirectY() {
     }
     uint16_t addr = lo | hi;
     addr += Y;
-    int cycles = 5;
+    int cycles = modeInfo(AddrMode::IndirectY).cycles;
     // Add 1 cycle if page crossed
     if ((addr & 0xFF00) != ((readBus(ptrAddr + 1) & 0xFF) << 8)) {
-        cycles++;
+        cycles += modeInfo(AddrMode::IndirectY).pageCrossPenalty;
     }
-    bool additionalCycles = true;
+    bool additionalCycles = modeInfo(AddrMode::IndirectY).addsOpCycles;
     return {addr, cycles, additionalCycles};
 }
 
@@ -1486,8 +1696,8 @@ CPU::AddressResult CPU::IndirectJMP() {
     lo = readBus(addr);
 
     addr = (hi << 8) | lo;
-    int cycles = 5;
-    bool additionalCycles = false;
+    int cycles = modeInfo(AddrMode::IndirectJMP).cycles;
+    bool additionalCycles = modeInfo(AddrMode::IndirectJMP).addsOpCycles;
 
     return {addr, cycles, additionalCycles};
 }
@@ -1526,8 +1736,9 @@ uint8_t CPU::stack_pop() {
 
 // CPU Handling of an NMI Interrupt
 void CPU::nmi_interrupt() {
+    interruptCount++;
     stack_push16(PC);
-    stack_push(P);
+    stack_push(status());
     setFlag(FLAGS::I, 1);
     PC = 0xFFFA;
     uint16_t lo = readBus(PC);
@@ -1540,15 +1751,17 @@ void CPU::nmi_interrupt() {
 void CPU::irq_interrupt() {
     // Check if interrupt is allowed
     if (getFlag(I) == 0) {
+        interruptCount++;
         // Push PC and P to stack
         stack_push16(PC);
         setFlag(B, false);
-        stack_push(P);
+        stack_push(status());
         setFlag(I, true);
         // Get new PC location
         const uint16_t read_address = 0xFFFE;
         uint16_t lo = readBus(read_address);
         uint16_t hi = readBus(read_address + 1);
         PC = (hi << 8) | lo;
+        cycles += 7;
     }
 }
@@ -5,9 +5,15 @@
 #ifndef CPU_H
 #define CPU_H
 
+#include <array>
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Opcodes.h"
 
 class Bus;
+class Dynarec;
 
 class CPU {
 public:
@@ -20,10 +26,19 @@ public:
     uint8_t Y;          // Y Register
     uint8_t S;          // Stack Pointer, start at 0xFD
     uint16_t PC;        // Program Counter, read memory at 0xFFFC and 0xFFFD for start of program;
-    uint8_t P;          // Status Flags Register, start with I and U
+    uint8_t P;          // Status Flags Register, start with I and U. Read it through status()
 
     uint32_t cycles;    // cycle countdown
 
+#ifndef CPU_EAGER_FLAGS
+    // Lazy flags. Instructions store their result here instead of updating P, and N/Z/C/V
+    // are only worked out when something looks at them (branches, getFlag, status()).
+    // P then only holds I, D, B and U. Build with CPU_EAGER_FLAGS to keep them all in P.
+    uint16_t nzResult = 1;  // Z when the low byte is 0, N when bit 7 or 8 is set
+    uint8_t carry = 0;      // 0 or 1
+    uint8_t overflow = 0;   // 0 or 1
+#endif
+
     // Flags
     enum FLAGS {
         C = (1 << 0),    // Carry
@@ -45,8 +60,9 @@ public:
     void reset();
     void execute();
     int cycleExecute();
+    void dispatch(uint8_t opcode);
     void printRegisters() const;
-    void initInstructionTable();
+    std::string disassemble(uint16_t address);
 
     // Interrupt Handling
     void nmi_interrupt();
@@ -55,6 +71,9 @@ public:
     // Flag operations
     void setFlag(FLAGS flag, bool set);
     uint8_t getFlag(FLAGS flag) const;
+    void setNZ(uint8_t result);         // N and Z from an instruction's result
+    uint8_t status() const;             // Full status register, as pushed to the stack
+    void setStatus(uint8_t value);
 
     // Stack Operations
     void stack_push(uint8_t value);
@@ -68,11 +87,77 @@ public:
         bool additionalCycles;
     };
 
-        struct Instruction {
+    struct Instruction {
         int (CPU::*operation)(uint16_t);
         AddressResult (CPU::*addressingMode)();
     };
-    Instruction instructionTable[256];
+    // Built at compile time from OPCODE_TABLE (Opcodes.h)
+    static const std::array<Instruction, 256> instructionTable;
+
+    // Templated handlers, one specialisation per (addressing mode, operation) pair
+    template<AddrMode M> AddressResult address();
+    template<Op O> int operate(uint16_t address);
+    template<AddrMode M, Op O> int exec();
+
+    // Predecoded instruction cache for code in internal RAM and PRG-ROM, one slot per
+    // CPU address (RAM mirrors share slots). A hit skips the opcode/operand bus reads and
+    // the decode switch. Set predecode to false to run the plain interpreter instead.
+    using DecodedHandler = int (*)(CPU&, uint16_t);
+    struct DecodedInstruction {
+        DecodedHandler handler;             // execDecoded<> for the opcode, nullptr if empty
+        uint16_t operand;                   // Operand bytes following the opcode
+        uint8_t opcode;
+    };
+    static const std::array<DecodedHandler, 256> decodedHandlers;
+    static constexpr int DECODE_RAM_SLOTS = 0x0800;
+    static constexpr int DECODE_ROM_SLOTS = 0x8000;
+    bool predecode = true;
+    std::vector<DecodedInstruction> decodeCache;    // Allocated on first use
+    uint8_t ramCodePages = 0;                       // 256 byte RAM pages that hold decoded code
+
+    DecodedInstruction* decodedAt(uint16_t address);
+    void invalidateDecodedAt(uint16_t address);
+    void invalidateDecodedRange(uint16_t start, uint16_t end);  // Call on PRG bank switch
+
+    // Called on every bus write. Only RAM pages holding decoded code and the cartridge
+    // window need any work, so ordinary data writes stay a single test.
+    void invalidateDecoded(uint16_t address) {
+        if (address <= 0x1FFF ? (ramCodePages >> ((address & 0x07FF) >> 8)) & 1
+                              : address >= 0x8000) {
+            invalidateDecodedAt(address);
+        }
+    }
+
+    template<AddrMode M> AddressResult decodedAddress(uint16_t operand);
+    template<AddrMode M, Op O> static int execDecoded(CPU& cpu, uint16_t operand);
+
+    // Idle loop skipping. A short loop that never writes and only reads RAM, ROM or
+    // PPUSTATUS, and comes back to its head with identical registers, will keep doing so
+    // until an NMI, Bus::syncClock or (when it polls PPUSTATUS) the next status flag
+    // change. Whole iterations up to that point are charged as cycles instead of run.
+    struct IdleLoop {
+        uint16_t head = 0;
+        uint16_t end = 0;               // Branch/JMP closing the loop
+        bool valid = false;
+        bool readsStatus = false;
+        int maxCycles = 0;              // One iteration, worst case
+        uint8_t A, X, Y, S, P;          // State at the last visit to head
+        uint8_t status;                 // PPUSTATUS flags at the last visit, if it reads them
+        uint32_t clock = 0;             // Bus::cpuClockCounter at the last visit
+        uint32_t interrupts = 0;
+    };
+    bool idleSkip = true;
+    IdleLoop idleLoop;
+    uint16_t lastInstructionPC = 0;
+    uint32_t interruptCount = 0;
+    uint64_t idleCyclesSkipped = 0;     // Running total, see NES::idleCyclesLastFrame
+
+    bool skipIdleLoop();
+    bool analyzeIdleLoop(uint16_t head);
+
+    // Optional recompiler for hot PRG-ROM blocks (Dynarec.h), off unless enabled
+    std::unique_ptr<Dynarec> dynarec;
+    void enableDynarec(bool enable, bool differential = false);
 
     // Addressing Modes
     AddressResult Implicit();
@@ -0,0 +1,31 @@
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+// Runtime checks for the SIMD kernels. A kernel that needs more than the build targets is
+// compiled on its own with __attribute__((target(...))) and only called once the matching
+// check passes, so the rest of the build doesn't need -mavx or -mavx2. CPUFEATURES_X86 says
+// whether such kernels can be compiled at all; without it every check is false.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPUFEATURES_X86
+#include <immintrin.h>
+#endif
+
+inline bool cpuHasAvx() {
+#ifdef CPUFEATURES_X86
+    static const bool avx = __builtin_cpu_supports("avx");
+    return avx;
+#else
+    return false;
+#endif
+}
+
+inline bool cpuHasAvx2() {
+#ifdef CPUFEATURES_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+#endif // CPUFEATURES_H
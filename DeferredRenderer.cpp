@@ -0,0 +1,197 @@
+#include "DeferredRenderer.h"
+#include "PPU.h"
+
+#include <algorithm>
+#include <cstring>
+
+DeferredRenderer::DeferredRenderer(unsigned threads) {
+    threads = std::clamp(threads, 1u, 240u);
+    for (unsigned band = 0; band < threads; band++) {
+        workers.push_back(std::make_unique<PPU>());
+    }
+    for (unsigned band = 1; band < threads; band++) {
+        pool.emplace_back(&DeferredRenderer::workerLoop, this, band);
+    }
+    entries.reserve(4096);
+}
+
+DeferredRenderer::~DeferredRenderer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    startBands.notify_all();
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+}
+
+void DeferredRenderer::beginFrame(const PPU& ppu) {
+    nameTables = ppu.nameTables;
+    patternTables = ppu.patternTables;
+    std::memcpy(palette, ppu.paletteMemory, sizeof(palette));
+    std::memcpy(oam, ppu.OAM, sizeof(oam));
+    mirroring = ppu.mirroring;
+    scanlineRenderer = ppu.scanlineRenderer;
+    entries.clear();
+}
+
+void DeferredRenderer::captureLine(const PPU& ppu) {
+    LineState& line = lines[ppu.scanline];
+    line.v = ppu.v.vram_register;
+    line.t = ppu.t.vram_register;
+    line.x = ppu.x;
+    line.w = ppu.w;
+    line.status = ppu.status.reg;
+    line.control = ppu.control.reg;
+    line.mask = ppu.mask.reg;
+    line.OAMADDR = ppu.OAMADDR;
+    line.dataBuffer = ppu.dataBuffer;
+    line.nextTileId = ppu.next_bg_tile_id;
+    line.nextTileAttribute = ppu.next_bg_tile_attribute;
+    line.nextTileLsb = ppu.next_bg_tile_lsb;
+    line.nextTileMsb = ppu.next_bg_tile_msb;
+    line.tileLo = ppu.bg_shifter_tile_lo;
+    line.tileHi = ppu.bg_shifter_tile_hi;
+    line.attributeLo = ppu.bg_shifter_attribute_lo;
+    line.attributeHi = ppu.bg_shifter_attribute_hi;
+    std::memcpy(line.arr, ppu.arr, sizeof(line.arr));
+    std::memcpy(line.spriteScanline, ppu.spriteScanline, sizeof(line.spriteScanline));
+    line.numOfSprites = ppu.numOfSprites;
+    std::memcpy(line.spriteLo, ppu.sprite_shifter_pattern_lo, sizeof(line.spriteLo));
+    std::memcpy(line.spriteHi, ppu.sprite_shifter_pattern_hi, sizeof(line.spriteHi));
+    line.zeroHitPossible = ppu.bSpriteZeroHitPossible;
+    line.zeroBeingRendered = ppu.bSpriteZeroBeingRendered;
+}
+
+void DeferredRenderer::log(const PPU& ppu, Kind kind, uint16_t addr, uint8_t data) {
+    entries.push_back({static_cast<uint32_t>(ppu.scanline * 341 + ppu.cycle), kind, data, addr});
+}
+
+void DeferredRenderer::apply(PPU& ppu, const Entry& entry) {
+    switch (entry.kind) {
+        case REGISTER_WRITE:
+        case VRAM_WRITE:
+            ppu.cpuWrite(entry.kind == VRAM_WRITE ? 0x0007 : entry.addr, entry.data);
+            break;
+        case REGISTER_READ:
+            ppu.cpuRead(entry.addr);
+            break;
+        case OAM_WRITE:
+            ppu.writeOAM(static_cast<uint8_t>(entry.addr), entry.data);
+            break;
+        case PATTERN_WRITE:
+            ppu.writePatternTable(entry.addr, entry.data);
+            break;
+        case MIRRORING:
+            ppu.setMirroring(static_cast<NESROM::Mirroring>(entry.data));
+            break;
+    }
+}
+
+void DeferredRenderer::renderBand(unsigned band) {
+    PPU& ppu = *workers[band];
+    int firstLine = 240 * band / workers.size();
+    int endLine = 240 * (band + 1) / workers.size();
+    uint32_t start = firstLine * 341;
+    uint32_t end = endLine * 341;
+
+    // Memory as it was when the band starts: the frame's start plus what changed since
+    ppu.nameTables = nameTables;
+    if (ppu.patternTables != patternTables) {
+        ppu.patternTables = patternTables;
+        ppu.invalidateTiles();
+    }
+    std::memcpy(ppu.paletteMemory, palette, sizeof(palette));
+    std::memcpy(ppu.OAM, oam, sizeof(oam));
+    ppu.setMirroring(mirroring);
+    size_t next = 0;
+    for (; next < entries.size() && entries[next].dot < start; next++) {
+        const Entry& entry = entries[next];
+        switch (entry.kind) {
+            case VRAM_WRITE:
+                ppu.writePPU(entry.addr, entry.data);
+                break;
+            case OAM_WRITE:
+            case PATTERN_WRITE:
+            case MIRRORING:
+                apply(ppu, entry);
+                break;
+            default:
+                break;      // Registers come from the line state
+        }
+    }
+
+    const LineState& line = lines[firstLine];
+    ppu.v.vram_register = line.v;
+    ppu.t.vram_register = line.t;
+    ppu.x = line.x;
+    ppu.w = line.w;
+    ppu.status.reg = line.status;
+    ppu.control.reg = line.control;
+    ppu.mask.reg = line.mask;
+    ppu.OAMADDR = line.OAMADDR;
+    ppu.dataBuffer = line.dataBuffer;
+    ppu.next_bg_tile_id = line.nextTileId;
+    ppu.next_bg_tile_attribute = line.nextTileAttribute;
+    ppu.next_bg_tile_lsb = line.nextTileLsb;
+    ppu.next_bg_tile_msb = line.nextTileMsb;
+    ppu.bg_shifter_tile_lo = line.tileLo;
+    ppu.bg_shifter_tile_hi = line.tileHi;
+    ppu.bg_shifter_attribute_lo = line.attributeLo;
+    ppu.bg_shifter_attribute_hi = line.attributeHi;
+    std::memcpy(ppu.arr, line.arr, sizeof(line.arr));
+    std::memcpy(ppu.spriteScanline, line.spriteScanline, sizeof(line.spriteScanline));
+    ppu.numOfSprites = line.numOfSprites;
+    std::memcpy(ppu.sprite_shifter_pattern_lo, line.spriteLo, sizeof(line.spriteLo));
+    std::memcpy(ppu.sprite_shifter_pattern_hi, line.spriteHi, sizeof(line.spriteHi));
+    ppu.bSpriteZeroHitPossible = line.zeroHitPossible;
+    ppu.bSpriteZeroBeingRendered = line.zeroBeingRendered;
+    ppu.paletteDirty = true;
+    ppu.spriteBucketsDirty = true;
+    ppu.scanline = firstLine;
+    ppu.cycle = 0;
+    ppu.clockCounter = start;
+    ppu.scanlineRenderer = scanlineRenderer;
+    ppu.framebuffer = target;
+
+    // Accesses land between dots exactly where they did in the frame
+    for (; next < entries.size() && entries[next].dot < end; next++) {
+        ppu.catchUp(entries[next].dot);
+        apply(ppu, entries[next]);
+    }
+    ppu.catchUp(end);
+}
+
+void DeferredRenderer::render(uint16_t* framebuffer) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        target = framebuffer;
+        bandsLeft = static_cast<unsigned>(pool.size());
+        generation++;
+    }
+    startBands.notify_all();
+    renderBand(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    bandsDone.wait(lock, [this] { return bandsLeft == 0; });
+}
+
+void DeferredRenderer::workerLoop(unsigned band) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            startBands.wait(lock, [this, seen] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        renderBand(band);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bandsLeft--;
+        }
+        bandsDone.notify_one();
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef DEFERREDRENDERER_H
+#define DEFERREDRENDERER_H
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ROM.h"
+
+class PPU;
+
+// Renders a frame's 240 visible lines on several threads once the frame is over.
+//
+// While the frame runs the PPU only keeps time (sprite zero hits, overflow and $2002 are
+// still answered as they happen) and tells us everything that can change the picture:
+// VRAM, OAM and pattern memory as they were at the start of line 0, its registers at the
+// start of every visible line, and each register access, OAM write (including DMA),
+// pattern write and mirroring switch with the dot it landed on. Each thread then takes a
+// band of lines, starts a PPU of its own from the band's first line and replays the log
+// over it dot for dot, so the pixels come out the same as drawing them on the spot.
+class DeferredRenderer {
+public:
+    enum Kind : uint8_t {
+        REGISTER_WRITE,     // addr is the register (0-7)
+        REGISTER_READ,      // Reads with side effects: $2002 clears w, $2007 moves v
+        VRAM_WRITE,         // $2007 write, addr is where it landed
+        OAM_WRITE,          // $2004 or DMA, addr is the OAM byte
+        PATTERN_WRITE,      // Straight to pattern memory, e.g. a CHR bank switch
+        MIRRORING           // data is the new NESROM::Mirroring
+    };
+
+    explicit DeferredRenderer(unsigned threads);
+    ~DeferredRenderer();
+
+    unsigned threads() const { return static_cast<unsigned>(workers.size()); }
+
+    // Called by the PPU on deferred frames
+    void beginFrame(const PPU& ppu);        // At dot 0 of line 0
+    void captureLine(const PPU& ppu);       // At dot 0 of each visible line
+    void log(const PPU& ppu, Kind kind, uint16_t addr, uint8_t data);
+
+    // Draws lines 0-239 into framebuffer, returns when all of them are done
+    void render(uint16_t* framebuffer);
+
+private:
+    struct Entry {
+        uint32_t dot;           // scanline * 341 + cycle
+        Kind kind;
+        uint8_t data;
+        uint16_t addr;
+    };
+
+    // Everything besides memory that decides what a line looks like
+    struct LineState {
+        uint16_t v, t;
+        uint8_t x, w;
+        uint8_t status, control, mask, OAMADDR, dataBuffer;
+        uint8_t nextTileId, nextTileAttribute, nextTileLsb, nextTileMsb;
+        uint16_t tileLo, tileHi, attributeLo, attributeHi;
+        uint8_t arr[16];
+        uint8_t spriteScanline[8 * 4];
+        uint8_t numOfSprites;
+        uint8_t spriteLo[8], spriteHi[8];
+        bool zeroHitPossible, zeroBeingRendered;
+    };
+
+    std::array<uint8_t, 4096> nameTables{};
+    std::array<uint8_t, 4096 * 4> patternTables{};
+    uint8_t palette[32]{};
+    uint8_t oam[256]{};
+    NESROM::Mirroring mirroring = NESROM::HORIZONTAL;
+    bool scanlineRenderer = true;
+    LineState lines[240]{};
+    std::vector<Entry> entries;
+
+    void renderBand(unsigned band);
+    static void apply(PPU& ppu, const Entry& entry);
+
+    // workers[i] draws band i, band 0 on the thread calling render
+    std::vector<std::unique_ptr<PPU>> workers;
+    std::vector<std::thread> pool;
+    std::mutex mutex;
+    std::condition_variable startBands;
+    std::condition_variable bandsDone;
+    uint64_t generation = 0;
+    unsigned bandsLeft = 0;
+    bool stopping = false;
+    uint16_t* target = nullptr;
+    void workerLoop(unsigned band);
+};
+
+#endif // DEFERREDRENDERER_H
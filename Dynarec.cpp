@@ -0,0 +1,525 @@
+#include "Dynarec.h"
+#include "Bus.h"
+#include "CPU.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define DYNAREC_NATIVE 1
+#include <sys/mman.h>
+#else
+#define DYNAREC_NATIVE 0
+#endif
+
+// ---------------------------------------------------------------------------- //
+// ----------------------------- BLOCK SELECTION ------------------------------ //
+// ---------------------------------------------------------------------------- //
+
+namespace {
+
+// N and Z bits of P for every 8 bit result
+constexpr std::array<uint8_t, 256> makeNZTable() {
+    std::array<uint8_t, 256> table{};
+    for (int v = 0; v < 256; v++) {
+        table[v] = (v == 0 ? CPU::Z : 0) | (v & 0x80 ? CPU::N : 0);
+    }
+    return table;
+}
+
+constexpr std::array<uint8_t, 256> NZ_TABLE = makeNZTable();
+
+// Instructions after which the next PC isn't known at compile time
+bool endsBlock(Op op) {
+    return isBranch(op) || op == Op::JMP || op == Op::JSR || op == Op::RTS ||
+           op == Op::RTI || op == Op::BRK;
+}
+
+// True if the instruction can only ever touch internal RAM or ROM, whatever X/Y hold.
+// Pointer modes are left out since their target isn't known until runtime.
+bool touchesOnlyMemory(const OpcodeInfo& info, uint16_t operand) {
+    bool writes = info.access == Access::Write || info.access == Access::ReadModifyWrite;
+    switch (info.mode) {
+        case AddrMode::Indirect:
+        case AddrMode::IndirectJMP:
+        case AddrMode::IndirectX:
+        case AddrMode::IndirectY:
+            return false;
+        case AddrMode::Absolute:
+            if (info.access == Access::None) {
+                return true;    // JMP/JSR target or NOP, no data access
+            }
+            return operand <= 0x1FFF || (!writes && operand >= 0x8000);
+        case AddrMode::AbsoluteX:
+        case AddrMode::AbsoluteY:
+            // Indexing may add up to 0xFF, wrapping from the top of ROM into RAM
+            return operand <= 0x1F00 || (!writes && operand >= 0x8000);
+        default:
+            // Implied, immediate, relative, zero page and stack accesses
+            return true;
+    }
+}
+
+// Called from native code when a store hits a RAM page holding predecoded code
+void invalidateRam(CPU* cpu, uint32_t address) {
+    cpu->invalidateDecodedAt(address);
+}
+
+// ---------------------------------------------------------------------------- //
+// ------------------------------ X86-64 EMITTER ------------------------------ //
+// ---------------------------------------------------------------------------- //
+
+// Minimal encoder for the instructions blocks are made of. Inside a block rbx holds the
+// CPU*, r12 the start of internal RAM and r13 NZ_TABLE. All 6502 state stays in the CPU
+// object, so handler calls see it up to date.
+struct Emitter {
+    uint8_t* p;
+
+    void bytes(std::initializer_list<uint8_t> list) {
+        for (uint8_t b : list) {
+            *p++ = b;
+        }
+    }
+    void imm8(uint8_t v) { *p++ = v; }
+    void imm16(uint16_t v) { std::memcpy(p, &v, 2); p += 2; }
+    void imm32(uint32_t v) { std::memcpy(p, &v, 4); p += 4; }
+    void imm64(uint64_t v) { std::memcpy(p, &v, 8); p += 8; }
+
+    void prologue(const uint8_t* ram) {
+        bytes({0x53});                                      // push rbx
+        bytes({0x41, 0x54});                                // push r12
+        bytes({0x41, 0x55});                                // push r13
+        bytes({0x48, 0x89, 0xFB});                          // mov rbx, rdi
+        bytes({0x49, 0xBC}); imm64(reinterpret_cast<uint64_t>(ram));              // mov r12, ram
+        bytes({0x49, 0xBD}); imm64(reinterpret_cast<uint64_t>(NZ_TABLE.data()));  // mov r13, NZ_TABLE
+    }
+
+    void epilogue() {
+        bytes({0x41, 0x5D});                                // pop r13
+        bytes({0x41, 0x5C});                                // pop r12
+        bytes({0x5B});                                      // pop rbx
+        bytes({0xC3});                                      // ret
+    }
+
+    // movzx eax, byte [rbx + off]
+    void loadReg(int32_t off) { bytes({0x0F, 0xB6, 0x83}); imm32(off); }
+    // mov byte [rbx + off], al
+    void storeReg(int32_t off) { bytes({0x88, 0x83}); imm32(off); }
+    // mov byte [rbx + off], value
+    void storeRegImm(int32_t off, uint8_t value) { bytes({0xC6, 0x83}); imm32(off); imm8(value); }
+    // mov word [rbx + off], value
+    void storeReg16Imm(int32_t off, uint16_t value) { bytes({0x66, 0xC7, 0x83}); imm32(off); imm16(value); }
+    // add dword [rbx + off], value
+    void addReg32Imm(int32_t off, uint32_t value) { bytes({0x81, 0x83}); imm32(off); imm32(value); }
+    // and byte [rbx + off], mask
+    void andRegImm(int32_t off, uint8_t mask) { bytes({0x80, 0xA3}); imm32(off); imm8(mask); }
+    // or byte [rbx + off], bits
+    void orRegImm(int32_t off, uint8_t bits) { bytes({0x80, 0x8B}); imm32(off); imm8(bits); }
+    // movzx eax, byte [r12 + off]
+    void loadRam(uint16_t off) { bytes({0x41, 0x0F, 0xB6, 0x84, 0x24}); imm32(off); }
+    // mov byte [r12 + off], al
+    void storeRam(uint16_t off) { bytes({0x41, 0x88, 0x84, 0x24}); imm32(off); }
+
+    // P = (P & ~clear) | NZ_TABLE[al] (| cl when withCarry)
+    void setFlagsFromAl(int32_t offP, uint8_t clear, bool withCarry) {
+        bytes({0x0F, 0xB6, 0xD0});                          // movzx edx, al
+        bytes({0x41, 0x0F, 0xB6, 0x54, 0x15, 0x00});        // movzx edx, byte [r13 + rdx]
+        if (withCarry) {
+            bytes({0x08, 0xCA});                            // or dl, cl
+        }
+        andRegImm(offP, static_cast<uint8_t>(~clear));
+        bytes({0x08, 0x93}); imm32(offP);                   // or byte [rbx + offP], dl
+    }
+
+    // Lazy flags: word [rbx + offNZ] = al (byte [rbx + offCarry] = cl when withCarry)
+    void storeLazyFlagsFromAl(int32_t offNZ, int32_t offCarry, bool withCarry) {
+        bytes({0x0F, 0xB6, 0xC0});                          // movzx eax, al
+        bytes({0x66, 0x89, 0x83}); imm32(offNZ);            // mov word [rbx + offNZ], ax
+        if (withCarry) {
+            bytes({0x88, 0x8B}); imm32(offCarry);           // mov byte [rbx + offCarry], cl
+        }
+    }
+
+    // target(cpu, arg), 20 bytes
+    void call(const void* target, uint32_t arg) {
+        bytes({0x48, 0x89, 0xDF});                          // mov rdi, rbx
+        bytes({0xBE}); imm32(arg);                          // mov esi, arg
+        bytes({0x48, 0xB8}); imm64(reinterpret_cast<uint64_t>(target)); // mov rax, target
+        bytes({0xFF, 0xD0});                                // call rax
+    }
+};
+
+} // namespace
+
+// ---------------------------------------------------------------------------- //
+// --------------------------------- DYNAREC ---------------------------------- //
+// ---------------------------------------------------------------------------- //
+
+Dynarec::Dynarec(CPU& cpu, Bus& bus) : cpu(cpu), bus(bus),
+    blockAt(0x8000, NO_BLOCK), heat(0x8000, 0) {
+    auto offset = [&cpu](const void* member) {
+        return static_cast<int32_t>(static_cast<const uint8_t*>(member) -
+                                    reinterpret_cast<const uint8_t*>(&cpu));
+    };
+    offA = offset(&cpu.A);
+    offX = offset(&cpu.X);
+    offY = offset(&cpu.Y);
+    offS = offset(&cpu.S);
+    offP = offset(&cpu.P);
+    offPC = offset(&cpu.PC);
+    offCycles = offset(&cpu.cycles);
+    offRamCodePages = offset(&cpu.ramCodePages);
+#ifndef CPU_EAGER_FLAGS
+    offNZ = offset(&cpu.nzResult);
+    offCarry = offset(&cpu.carry);
+    offOverflow = offset(&cpu.overflow);
+#endif
+
+#if DYNAREC_NATIVE
+    void* memory = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Dynarec: unable to map code buffer, using the interpreter\n";
+    } else {
+        code = static_cast<uint8_t*>(memory);
+        mprotect(code, CODE_SIZE, PROT_READ | PROT_EXEC);
+    }
+#endif
+}
+
+Dynarec::~Dynarec() {
+#if DYNAREC_NATIVE
+    if (code) {
+        munmap(code, CODE_SIZE);
+    }
+#endif
+}
+
+bool Dynarec::supported() {
+    return DYNAREC_NATIVE;
+}
+
+void Dynarec::flush() {
+    if (blockAt.empty() || !compiledAny) {
+        return;     // Cheap for the PRG writes done while loading a ROM
+    }
+    compiledAny = false;
+    blocks.clear();
+    std::fill(blockAt.begin(), blockAt.end(), NO_BLOCK);
+    std::fill(heat.begin(), heat.end(), 0);
+    codeUsed = 0;
+}
+
+bool Dynarec::run() {
+    uint16_t pc = cpu.PC;
+    if (!code || pc < 0x8000) {
+        return false;   // Code in RAM or cartridge RAM is interpreted, it may be rewritten
+    }
+
+    int32_t index = blockAt[pc - 0x8000];
+    if (index == NO_BLOCK) {
+        if (++heat[pc - 0x8000] < HOT_THRESHOLD) {
+            return false;
+        }
+        index = compile(pc);
+        blockAt[pc - 0x8000] = index;
+        compiledAny = true;
+    }
+    if (index < 0) {
+        return false;
+    }
+
+    const Block& block = blocks[index];
+    if (!fitsBudget(block)) {
+        return false;
+    }
+
+    if (differential) {
+        runDifferential(block);
+    } else {
+        block.code(&cpu);
+    }
+    blocksRun++;
+    instructionsRun += block.instructions;
+    return true;
+}
+
+// The block executes at the current master clock tick, but the interpreter would have
+// spread it over the next 3 * cycles ticks. That is only invisible if no NMI is raised
+// (it would push a PC from the middle of the block), no IRQ is or may become pending (a
+// DMC fetch can raise one), and nobody looks at the CPU from outside (Bus::syncClock)
+// before then.
+bool Dynarec::fitsBudget(const Block& block) const {
+    if (bus.ppu.nmi || bus.apu->irqPending()) {
+        return false;
+    }
+    uint32_t ticks = 3 * block.maxCycles;
+    if (bus.ticksUntilDot(241, 1) < ticks || bus.ticksUntilDmcFetch() < ticks) {
+        return false;
+    }
+    return bus.syncClock - bus.clockCounter >= ticks;
+}
+
+// Scans forward from start, emits native code and returns the new block's index, or
+// NOT_COMPILABLE when not even the first instruction qualifies.
+int32_t Dynarec::compile(uint16_t start) {
+#if DYNAREC_NATIVE
+    struct Decoded {
+        uint16_t pc;
+        uint8_t opcode;
+        uint16_t operand;
+    };
+    std::vector<Decoded> list;
+    int maxCycles = 0;
+
+    int pc = start;
+    while (static_cast<int>(list.size()) < MAX_BLOCK_INSTRUCTIONS) {
+        uint8_t opcode = bus.read(pc);
+        const OpcodeInfo& info = OPCODE_TABLE[opcode];
+        if (!info.valid || pc + info.bytes - 1 > 0xFFFF) {
+            break;
+        }
+        uint16_t operand = 0;
+        if (info.bytes > 1) operand = bus.read(pc + 1);
+        if (info.bytes > 2) operand |= bus.read(pc + 2) << 8;
+        if (!touchesOnlyMemory(info, operand)) {
+            break;
+        }
+
+        list.push_back({static_cast<uint16_t>(pc), opcode, operand});
+        maxCycles += worstCaseCycles(info);
+        pc += info.bytes;
+        if (endsBlock(info.op) || pc > 0xFFFF) {
+            break;
+        }
+    }
+    if (list.empty()) {
+        return NOT_COMPILABLE;
+    }
+
+    if (codeUsed + MAX_BLOCK_BYTES > CODE_SIZE) {
+        flush();
+    }
+    mprotect(code, CODE_SIZE, PROT_READ | PROT_WRITE);
+
+    Emitter e{code + codeUsed};
+    e.prologue(bus.cpuRam.data());
+
+    // Flag updates, into P or the CPU's lazy flag fields
+#ifndef CPU_EAGER_FLAGS
+    auto setNZFromAl = [&](bool withCarry) { e.storeLazyFlagsFromAl(offNZ, offCarry, withCarry); };
+    auto setNZConstant = [&](uint8_t value) { e.storeReg16Imm(offNZ, value); };
+    auto setCarryConstant = [&](bool set) { e.storeRegImm(offCarry, set); };
+    auto clearOverflow = [&]() { e.storeRegImm(offOverflow, 0); };
+#else
+    auto setNZFromAl = [&](bool withCarry) {
+        e.setFlagsFromAl(offP, withCarry ? CPU::C | CPU::Z | CPU::N : CPU::Z | CPU::N, withCarry);
+    };
+    auto setNZConstant = [&](uint8_t value) {
+        e.andRegImm(offP, static_cast<uint8_t>(~(CPU::Z | CPU::N)));
+        if (NZ_TABLE[value]) {
+            e.orRegImm(offP, NZ_TABLE[value]);
+        }
+    };
+    auto setCarryConstant = [&](bool set) {
+        if (set) {
+            e.orRegImm(offP, CPU::C);
+        } else {
+            e.andRegImm(offP, static_cast<uint8_t>(~CPU::C));
+        }
+    };
+    auto clearOverflow = [&]() { e.andRegImm(offP, static_cast<uint8_t>(~CPU::V)); };
+#endif
+
+    uint32_t inlineCycles = 0;      // Handlers add their own, inline code adds these at the end
+    bool pcCurrent = false;         // Handlers leave PC past their instruction
+    for (const Decoded& d : list) {
+        const OpcodeInfo& info = OPCODE_TABLE[d.opcode];
+        uint8_t lo = d.operand & 0xFF;
+        bool ramOperand = info.mode == AddrMode::ZeroPage ||
+                          (info.mode == AddrMode::Absolute && d.operand <= 0x1FFF);
+        bool romOperand = info.mode == AddrMode::Absolute && d.operand >= 0x8000;
+        uint16_t ramOffset = d.operand & 0x07FF;
+
+        int32_t reg = -1;
+        switch (info.op) {
+            case Op::LDA: case Op::STA: case Op::CMP: reg = offA; break;
+            case Op::LDX: case Op::STX: case Op::CPX: reg = offX; break;
+            case Op::LDY: case Op::STY: case Op::CPY: reg = offY; break;
+            default: break;
+        }
+
+        bool emitted = true;
+        switch (info.op) {
+            case Op::LDA: case Op::LDX: case Op::LDY:
+                if (info.mode == AddrMode::Immediate || romOperand) {
+                    // Constant, PRG is fixed while the block exists
+                    uint8_t value = info.mode == AddrMode::Immediate ? lo : bus.read(d.operand);
+                    e.storeRegImm(reg, value);
+                    setNZConstant(value);
+                } else if (ramOperand) {
+                    e.loadRam(ramOffset);
+                    e.storeReg(reg);
+                    setNZFromAl(false);
+                } else {
+                    emitted = false;
+                }
+                break;
+
+            case Op::STA: case Op::STX: case Op::STY:
+                if (ramOperand) {
+                    e.loadReg(reg);
+                    e.storeRam(ramOffset);
+                    // Let the CPU drop predecoded instructions in this page
+                    e.bytes({0xF6, 0x83}); e.imm32(offRamCodePages); e.imm8(1 << (ramOffset >> 8));
+                    e.bytes({0x74, 20});                    // jz over the call
+                    e.call(reinterpret_cast<const void*>(&invalidateRam), d.operand);
+                } else {
+                    emitted = false;
+                }
+                break;
+
+            case Op::TAX: e.loadReg(offA); e.storeReg(offX); setNZFromAl(false); break;
+            case Op::TAY: e.loadReg(offA); e.storeReg(offY); setNZFromAl(false); break;
+            case Op::TXA: e.loadReg(offX); e.storeReg(offA); setNZFromAl(false); break;
+            case Op::TYA: e.loadReg(offY); e.storeReg(offA); setNZFromAl(false); break;
+            case Op::TSX: e.loadReg(offS); e.storeReg(offX); setNZFromAl(false); break;
+            case Op::TXS: e.loadReg(offX); e.storeReg(offS); break;
+
+            case Op::INX: case Op::INY: case Op::DEX: case Op::DEY: {
+                int32_t target = (info.op == Op::INX || info.op == Op::DEX) ? offX : offY;
+                e.loadReg(target);
+                if (info.op == Op::INX || info.op == Op::INY) {
+                    e.bytes({0xFE, 0xC0});                  // inc al
+                } else {
+                    e.bytes({0xFE, 0xC8});                  // dec al
+                }
+                e.storeReg(target);
+                setNZFromAl(false);
+                break;
+            }
+
+            case Op::CLC: setCarryConstant(false); break;
+            case Op::SEC: setCarryConstant(true); break;
+            case Op::CLI: e.andRegImm(offP, static_cast<uint8_t>(~CPU::I)); break;
+            case Op::SEI: e.orRegImm(offP, CPU::I); break;
+            case Op::CLD: e.andRegImm(offP, static_cast<uint8_t>(~CPU::D)); break;
+            case Op::SED: e.orRegImm(offP, CPU::D); break;
+            case Op::CLV: clearOverflow(); break;
+
+            case Op::AND: case Op::ORA: case Op::EOR:
+                if (info.mode == AddrMode::Immediate) {
+                    e.loadReg(offA);
+                    uint8_t opcode = info.op == Op::AND ? 0x24 : info.op == Op::ORA ? 0x0C : 0x34;
+                    e.bytes({opcode, lo});                  // and/or/xor al, imm
+                    e.storeReg(offA);
+                    setNZFromAl(false);
+                } else {
+                    emitted = false;
+                }
+                break;
+
+            case Op::CMP: case Op::CPX: case Op::CPY:
+                if (info.mode == AddrMode::Immediate) {
+                    e.loadReg(reg);
+                    e.bytes({0x3C, lo});                    // cmp al, imm
+                    e.bytes({0x0F, 0x93, 0xC1});            // setae cl (carry = no borrow)
+                    e.bytes({0x2C, lo});                    // sub al, imm
+                    setNZFromAl(true);
+                } else {
+                    emitted = false;
+                }
+                break;
+
+            case Op::NOP:
+                // This core's NOPs never touch memory, only the cycle count matters
+                emitted = info.mode != AddrMode::AbsoluteX;
+                break;
+
+            default:
+                emitted = false;
+                break;
+        }
+
+        if (emitted) {
+            inlineCycles += info.cycles;
+            pcCurrent = false;
+        } else {
+            // Handler call, with PC just past the opcode as cycleExecute leaves it
+            e.storeReg16Imm(offPC, d.pc + 1);
+            e.call(reinterpret_cast<const void*>(CPU::decodedHandlers[d.opcode]), d.operand);
+            pcCurrent = true;
+        }
+    }
+
+    if (!pcCurrent) {
+        e.storeReg16Imm(offPC, pc);
+    }
+    if (inlineCycles) {
+        e.addReg32Imm(offCycles, inlineCycles);
+    }
+    e.epilogue();
+
+    Block block;
+    block.code = reinterpret_cast<BlockFunction>(code + codeUsed);
+    block.start = start;
+    block.instructions = static_cast<int>(list.size());
+    block.maxCycles = maxCycles;
+
+    codeUsed = e.p - code;
+    mprotect(code, CODE_SIZE, PROT_READ | PROT_EXEC);
+
+    blocks.push_back(block);
+    blocksCompiled++;
+    return static_cast<int32_t>(blocks.size() - 1);
+#else
+    (void)start;
+    return NOT_COMPILABLE;
+#endif
+}
+
+// Runs the block natively, rewinds, runs the same instructions on the interpreter and
+// compares the two end states
+void Dynarec::runDifferential(const Block& block) {
+    struct State {
+        uint8_t A, X, Y, S, P;
+        uint16_t PC;
+        uint32_t cycles;
+        std::array<uint8_t, 2 * 1024> ram;
+
+        bool operator==(const State& o) const {
+            return A == o.A && X == o.X && Y == o.Y && S == o.S && P == o.P &&
+                   PC == o.PC && cycles == o.cycles && ram == o.ram;
+        }
+    };
+    auto save = [this]() {
+        return State{cpu.A, cpu.X, cpu.Y, cpu.S, cpu.status(), cpu.PC, cpu.cycles, bus.cpuRam};
+    };
+    auto restore = [this](const State& s) {
+        cpu.A = s.A; cpu.X = s.X; cpu.Y = s.Y; cpu.S = s.S; cpu.setStatus(s.P);
+        cpu.PC = s.PC; cpu.cycles = s.cycles; bus.cpuRam = s.ram;
+    };
+
+    State before = save();
+    block.code(&cpu);
+    State native = save();
+
+    restore(before);
+    for (int i = 0; i < block.instructions; i++) {
+        cpu.dispatch(cpu.readBus(cpu.PC++));
+    }
+    State interpreted = save();
+
+    if (!(native == interpreted)) {
+        mismatches++;
+        std::cerr << std::hex << "Dynarec mismatch in block $" << block.start
+                  << ": native A=" << int(native.A) << " X=" << int(native.X) << " Y=" << int(native.Y)
+                  << " S=" << int(native.S) << " P=" << int(native.P) << " PC=" << native.PC
+                  << " cycles=" << native.cycles
+                  << ", interpreter A=" << int(interpreted.A) << " X=" << int(interpreted.X)
+                  << " Y=" << int(interpreted.Y) << " S=" << int(interpreted.S) << " P=" << int(interpreted.P)
+                  << " PC=" << interpreted.PC << " cycles=" << interpreted.cycles
+                  << (native.ram == interpreted.ram ? "" : ", RAM differs") << std::dec << "\n";
+    }
+}
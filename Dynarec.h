@@ -0,0 +1,87 @@
+#ifndef DYNAREC_H
+#define DYNAREC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Bus;
+class CPU;
+
+// Optional recompiler for hot PRG-ROM basic blocks (x86-64 POSIX hosts only).
+//
+// A block is a straight run of instructions that only touch internal RAM and ROM, ending
+// at the first branch/jump/return or before the first instruction that could reach PPU,
+// APU or cartridge registers. Simple loads, stores, transfers, flag and compare ops are
+// emitted inline; everything else calls the CPU's predecoded handler for the opcode, so
+// behaviour and cycle counts stay those of the interpreter.
+//
+// A block runs all at once, so it is only entered when its worst-case cycle count ends
+// before the next vblank NMI and before Bus::syncClock. Anything else (code in RAM, I/O,
+// interrupts) stays on the interpreter.
+class Dynarec {
+public:
+    Dynarec(CPU& cpu, Bus& bus);
+    ~Dynarec();
+
+    // True when native code can be generated on this host
+    static bool supported();
+
+    // Runs the block at cpu.PC, compiling it once it is hot. Returns false when the
+    // interpreter has to execute the next instruction instead.
+    bool run();
+
+    // Drops every compiled block, e.g. after PRG-ROM writes or a bank switch
+    void flush();
+
+    // Runs each block natively, then again on the interpreter from the same state, and
+    // reports any difference in registers, cycles or RAM. The interpreter result is kept.
+    bool differential = false;
+
+    // Statistics
+    uint64_t blocksCompiled = 0;
+    uint64_t blocksRun = 0;
+    uint64_t instructionsRun = 0;
+    uint64_t mismatches = 0;
+
+private:
+    using BlockFunction = void (*)(CPU*);
+
+    struct Block {
+        BlockFunction code;
+        uint16_t start;
+        int instructions;
+        int maxCycles;      // Worst case, including page crosses and taken branches
+    };
+
+    static constexpr int HOT_THRESHOLD = 16;
+    static constexpr int MAX_BLOCK_INSTRUCTIONS = 32;
+    static constexpr int MAX_BLOCK_BYTES = 4096;
+    static constexpr size_t CODE_SIZE = 1 << 20;
+
+    static constexpr int32_t NO_BLOCK = -1;
+    static constexpr int32_t NOT_COMPILABLE = -2;
+
+    CPU& cpu;
+    Bus& bus;
+
+    std::vector<Block> blocks;
+    std::vector<int32_t> blockAt;   // Index into blocks per PRG address, or NO_BLOCK/NOT_COMPILABLE
+    std::vector<uint16_t> heat;     // Interpreter entries per PRG address
+
+    uint8_t* code = nullptr;        // mmap'd, writable only while compiling
+    size_t codeUsed = 0;
+    bool compiledAny = false;       // Anything in blockAt to flush
+
+    // Offsets of CPU members for [rbx + disp32] addressing
+    int32_t offA, offX, offY, offS, offP, offPC, offCycles, offRamCodePages;
+#ifndef CPU_EAGER_FLAGS
+    int32_t offNZ, offCarry, offOverflow;
+#endif
+
+    int32_t compile(uint16_t start);
+    bool fitsBudget(const Block& block) const;
+    void runDifferential(const Block& block);
+};
+
+#endif // DYNAREC_H
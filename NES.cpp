@@ -1,4 +1,7 @@
 #include "NES.h"
+#include "PixelConvert.h"
+#include <algorithm>
+#include <fstream>
 
 
 void NES::load_rom(const char *filename) {
@@ -37,10 +40,6 @@ void NES::initNES() {
         return;
     }
 
-    std::cout << "Connecting CPU to Bus...\n";
-    bus.cpu = &cpu;
-    cpu.connectBus(&bus);
-
     std::cout << "Calling cpu.reset()\n";
     cpu.reset();
 
@@ -68,17 +67,27 @@ void NES::run() {
     }
 }
 
-void NES::cycle() {
-    if (!on) return;
-
+void NES::runFrame() {
     // Target PPU cycles per NES frame (341 × 262 = ~89342)
     const int targetCycles = 89342;
 
+    bus.ppu.timingOnly = framesRun % (frameSkip + 1) != 0;
+    framesRun++;
+
+    uint64_t idleBefore = cpu.idleCyclesSkipped;
+    bus.syncClock = bus.clockCounter + targetCycles;
+    bus.runUntil(bus.syncClock);  // PPU/APU/CPU interleaved as if clocked one tick at a time
+    bus.apu->endFrame();
+    idleCyclesLastFrame = cpu.idleCyclesSkipped - idleBefore;
+}
+
+void NES::cycle() {
+    if (!on) return;
+
     auto start = std::chrono::high_resolution_clock::now();
 
-    for (int i = 0; i < targetCycles; i++) {
-        bus.clock();  // This will automatically call PPU/APU/CPU as needed
-    }
+    runFrame();
+    bus.apu->queueAudio();
 
     auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double, std::milli> elapsed = end - start;
@@ -94,14 +103,62 @@ void NES::end() {
     on = false;
 }
 
+// 16-bit PCM mono, little endian whatever the host is
+static bool writeWav(const char* filename, const std::vector<float>& samples, int sampleRate) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    auto put = [&file](uint32_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            file.put(static_cast<char>(value >> (8 * i)));
+        }
+    };
+    uint32_t dataSize = static_cast<uint32_t>(samples.size() * 2);
+    file.write("RIFF", 4);
+    put(36 + dataSize, 4);
+    file.write("WAVEfmt ", 8);
+    put(16, 4);                 // fmt chunk size
+    put(1, 2);                  // PCM
+    put(1, 2);                  // Mono
+    put(sampleRate, 4);
+    put(sampleRate * 2, 4);     // Bytes per second
+    put(2, 2);                  // Bytes per sample
+    put(16, 2);                 // Bits per sample
+    file.write("data", 4);
+    put(dataSize, 4);
+    for (float sample : samples) {
+        put(static_cast<uint16_t>(static_cast<int16_t>(std::clamp(sample, -1.0f, 1.0f) * 32767.0f)), 2);
+    }
+    return static_cast<bool>(file);
+}
 
-uint32_t* NES::getFramebuffer() {
-    // for (int i = 0; i < 256 * 240; i++) {
-    //     rgbFramebuffer[i] = nesPalette[i % 64];
-    //     uint8_t colorIndex = framebuffer[i];  // Get NES color index
-    //     rgbFramebuffer[i] = 0xFF000000 | nesPalette[colorIndex % 64];  // Convert to 32-bit ARGB
-    // }
-    return bus.ppu.rgbFramebuffer;
+bool NES::exportAudio(const char* filename, int frames) {
+    if (!on) return false;
+
+    std::vector<float> samples;
+    for (int i = 0; i < frames; i++) {
+        runFrame();
+        samples.insert(samples.end(), bus.apu->samples.begin(), bus.apu->samples.end());
+        bus.apu->samples.clear();
+    }
+    return writeWav(filename, samples, bus.apu->sampleRate);
+}
+
+
+const uint16_t* NES::getPixels() {
+    return bus.ppu.frames.latest();
+}
+
+const uint32_t* NES::getFramebuffer() {
+    // A new frame always comes in a different buffer, so only frames that get shown are
+    // converted and only once
+    const uint16_t* frame = getPixels();
+    if (frame != convertedFrame) {
+        convertPixels(frame, rgbFramebuffer, 256 * 240, PPU::EMPHASIS_PALETTES.data());
+        convertedFrame = frame;
+    }
+    return rgbFramebuffer;
 }
 
 void NES::RandomizeFramebuffer() {
@@ -111,6 +168,6 @@ void NES::RandomizeFramebuffer() {
         uint8_t b = rand() % 256;
 
         // Set the pixel in framebuffer as a 32-bit ARGB value
-        framebuffer[i] = 0xFF000000 | (r << 16) | (g << 8) | b;
+        rgbFramebuffer[i] = 0xFF000000 | (r << 16) | (g << 8) | b;
     }
 }
\ No newline at end of file
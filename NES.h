@@ -14,16 +14,23 @@ class NES {
 public:
     // Public member variables
     Bus bus;
-    CPU cpu;
+    CPU& cpu = *bus.cpu;    // The Bus owns the CPU, no second instance
     NESROM rom{};
     bool on = false;
     bool rom_loaded = false;
     bool A_changed = false;
     int count = 0;
     bool paused = false;
+    uint64_t idleCyclesLastFrame = 0;  // CPU cycles skipped in idle loops during the last cycle()
 
-    uint8_t framebuffer[256 * 240]{};  // 8-bit color indices
-    uint32_t rgbFramebuffer[256 * 240]{}; // 32-bit color for SDL
+    // Frame skip: after each frame drawn, this many frames run timing only (see
+    // PPU::timingOnly). 0 draws every frame.
+    unsigned frameSkip = 0;
+    uint64_t framesRun = 0;
+
+    // 32-bit color for SDL, the last frame getFramebuffer converted
+    uint32_t rgbFramebuffer[256 * 240]{};
+    const uint16_t* convertedFrame = nullptr;
 
     uint32_t nesPalette[64] = {
         0x666666, 0x002A88, 0x1412A7, 0x3B00A4, 0x5C007E, 0x6E0040, 0x6C0600, 0x561D00,
@@ -40,10 +47,16 @@ public:
     void load_rom(const char *filename);
     void initNES();
     void run();
-    void cycle();
+    void runFrame();    // One frame's worth of ticks, audio left in bus.apu->samples
+    void cycle();       // runFrame, play its audio and wait out the rest of the frame
     void end();
 
-    uint32_t* getFramebuffer();
+    // Runs frames as fast as they go and saves their audio as a WAV file, resampled the same
+    // way as the live audio. False if the NES is off or the file can't be written.
+    bool exportAudio(const char* filename, int frames);
+
+    const uint16_t* getPixels();        // Newest complete frame as PPU pixel values, see PPU::frames
+    const uint32_t* getFramebuffer();   // Same frame as RGBA, converted when it changes
     void RandomizeFramebuffer();
 
 };
@@ -0,0 +1,520 @@
+//
+// Compile-time 6502 opcode metadata shared by the CPU core and any tooling
+// (disassembly, tracing, predecoding).
+//
+
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <array>
+#include <cstdint>
+
+// ---------------------------------------------------------------------------- //
+// ----------------------------- ADDRESSING MODES ----------------------------- //
+// ---------------------------------------------------------------------------- //
+
+// (name, operand bytes, base cycles, adds operation cycles, page-cross penalty)
+// Base cycles and the "adds operation cycles" flag are what the interpreter charges,
+// the extra cycles returned by the operation are only counted when the flag is set.
+#define CPU_ADDRESSING_MODES(X)           \
+    X(Implicit,    0, 2, true,  0)        \
+    X(Immediate,   1, 2, false, 0)        \
+    X(Accumulator, 0, 2, false, 0)        \
+    X(Relative,    1, 2, true,  1)        \
+    X(ZeroPage,    1, 3, true,  0)        \
+    X(ZeroPageX,   1, 4, true,  0)        \
+    X(ZeroPageY,   1, 4, true,  0)        \
+    X(Absolute,    2, 4, true,  0)        \
+    X(AbsoluteX,   2, 4, true,  1)        \
+    X(AbsoluteY,   2, 4, true,  1)        \
+    X(Indirect,    2, 5, false, 0)        \
+    X(IndirectX,   1, 6, false, 0)        \
+    X(IndirectY,   1, 5, true,  1)        \
+    X(IndirectJMP, 2, 5, false, 0)
+
+enum class AddrMode : uint8_t {
+#define X(name, bytes, cycles, addsOpCycles, pageCross) name,
+    CPU_ADDRESSING_MODES(X)
+#undef X
+};
+
+struct AddrModeInfo {
+    const char* name;
+    uint8_t operandBytes;       // Bytes following the opcode
+    uint8_t cycles;             // Cycles charged by the addressing mode
+    bool addsOpCycles;          // Whether the operation's extra cycles are charged
+    uint8_t pageCrossPenalty;   // Extra cycle when indexing (or a taken branch) crosses a page
+};
+
+inline constexpr AddrModeInfo ADDRESSING_MODES[] = {
+#define X(name, bytes, cycles, addsOpCycles, pageCross) {#name, bytes, cycles, addsOpCycles, pageCross},
+    CPU_ADDRESSING_MODES(X)
+#undef X
+};
+
+constexpr const AddrModeInfo& modeInfo(AddrMode mode) {
+    return ADDRESSING_MODES[static_cast<uint8_t>(mode)];
+}
+
+// ---------------------------------------------------------------------------- //
+// -------------------------------- OPERATIONS -------------------------------- //
+// ---------------------------------------------------------------------------- //
+
+// Kind of memory access an operation performs on its effective address
+enum class Access : uint8_t {
+    None,               // Registers, stack or control flow only
+    Read,
+    Write,
+    ReadModifyWrite
+};
+
+// (name, access, extra cycles returned by the operation)
+// Branches return their taken/page-cross cycles at runtime on top of the 0 listed here.
+#define CPU_OPERATIONS(X)          \
+    /* Access */                   \
+    X(LDA, Read,            0)     \
+    X(LDX, Read,            0)     \
+    X(LDY, Read,            0)     \
+    X(STA, Write,           0)     \
+    X(STX, Write,           0)     \
+    X(STY, Write,           0)     \
+    /* Transfer */                 \
+    X(TAX, None,            0)     \
+    X(TAY, None,            0)     \
+    X(TSX, None,            0)     \
+    X(TXA, None,            0)     \
+    X(TXS, None,            0)     \
+    X(TYA, None,            0)     \
+    /* Arithmetic */               \
+    X(ADC, Read,            0)     \
+    X(SBC, Read,            0)     \
+    X(BIT, Read,            0)     \
+    X(AND, Read,            0)     \
+    X(ORA, Read,            0)     \
+    X(EOR, Read,            0)     \
+    X(INY, None,            0)     \
+    X(INX, None,            0)     \
+    X(DEY, None,            0)     \
+    X(DEX, None,            0)     \
+    X(INC, ReadModifyWrite, 2)     \
+    X(DEC, ReadModifyWrite, 2)     \
+    /* Jump */                     \
+    X(JMP, None,           -1)     \
+    X(JSR, None,            2)     \
+    X(RTS, None,            4)     \
+    X(BRK, None,            5)     \
+    X(RTI, None,            4)     \
+    /* Stack */                    \
+    X(PHA, None,            1)     \
+    X(PLA, None,            2)     \
+    X(PHP, None,            1)     \
+    X(PLP, None,            2)     \
+    /* Flag */                     \
+    X(CLI, None,            0)     \
+    X(SEI, None,            0)     \
+    X(SEC, None,            0)     \
+    X(CLC, None,            0)     \
+    X(CLD, None,            0)     \
+    X(SED, None,            0)     \
+    X(CLV, None,            0)     \
+    /* Branch */                   \
+    X(BEQ, None,            0)     \
+    X(BNE, None,            0)     \
+    X(BCS, None,            0)     \
+    X(BCC, None,            0)     \
+    X(BMI, None,            0)     \
+    X(BPL, None,            0)     \
+    X(BVS, None,            0)     \
+    X(BVC, None,            0)     \
+    /* Shift */                    \
+    X(ASL, ReadModifyWrite, 2)     \
+    X(LSR, ReadModifyWrite, 2)     \
+    X(ROL, ReadModifyWrite, 2)     \
+    X(ROR, ReadModifyWrite, 2)     \
+    /* Compare */                  \
+    X(CMP, Read,            0)     \
+    X(CPX, Read,            0)     \
+    X(CPY, Read,            0)     \
+    /* No Operation */             \
+    X(NOP, None,            0)     \
+    /* Unofficial */               \
+    X(SLO, ReadModifyWrite, 2)     \
+    X(RLA, ReadModifyWrite, 2)     \
+    X(SRE, ReadModifyWrite, 2)     \
+    X(RRA, ReadModifyWrite, 2)     \
+    X(SAX, Write,           0)     \
+    X(LAX, Read,            0)     \
+    X(DCP, ReadModifyWrite, 2)     \
+    X(ISC, ReadModifyWrite, 2)     \
+    X(ANC, Read,            0)     \
+    X(ALR, Read,            0)     \
+    X(ARR, Read,            0)     \
+    X(AXS, Read,            0)
+
+enum class Op : uint8_t {
+#define X(name, access, cycles) name,
+    CPU_OPERATIONS(X)
+#undef X
+    Invalid
+};
+
+struct OperationInfo {
+    const char* mnemonic;
+    Access access;
+    int8_t cycles;              // Extra cycles returned by the operation
+};
+
+inline constexpr OperationInfo OPERATIONS[] = {
+#define X(name, access, cycles) {#name, Access::access, cycles},
+    CPU_OPERATIONS(X)
+#undef X
+    {"???", Access::None, 0}
+};
+
+constexpr const OperationInfo& operationInfo(Op op) {
+    return OPERATIONS[static_cast<uint8_t>(op)];
+}
+
+// ---------------------------------------------------------------------------- //
+// ------------------------------- OPCODE LIST -------------------------------- //
+// ---------------------------------------------------------------------------- //
+
+// Every documented and supported undocumented opcode as (opcode, operation, addressing mode).
+// Expanded into OPCODE_TABLE, the legacy instructionTable and the fused dispatch switch,
+// so all of them agree on the decoding.
+#define CPU_OPCODES(X) \
+    /* LDA */                          \
+    X(0xA9, LDA, Immediate)            \
+    X(0xA5, LDA, ZeroPage)             \
+    X(0xB5, LDA, ZeroPageX)            \
+    X(0xAD, LDA, Absolute)             \
+    X(0xBD, LDA, AbsoluteX)            \
+    X(0xB9, LDA, AbsoluteY)            \
+    X(0xA1, LDA, IndirectX)            \
+    X(0xB1, LDA, IndirectY)            \
+                                       \
+    /* LDX */                          \
+    X(0xA2, LDX, Immediate)            \
+    X(0xA6, LDX, ZeroPage)             \
+    X(0xB6, LDX, ZeroPageY)            \
+    X(0xAE, LDX, Absolute)             \
+    X(0xBE, LDX, AbsoluteY)            \
+                                       \
+    /* LDY */                          \
+    X(0xA0, LDY, Immediate)            \
+    X(0xA4, LDY, ZeroPage)             \
+    X(0xB4, LDY, ZeroPageX)            \
+    X(0xAC, LDY, Absolute)             \
+    X(0xBC, LDY, AbsoluteX)            \
+                                       \
+    /* STA */                          \
+    X(0x85, STA, ZeroPage)             \
+    X(0x95, STA, ZeroPageX)            \
+    X(0x8D, STA, Absolute)             \
+    X(0x9D, STA, AbsoluteX)            \
+    X(0x99, STA, AbsoluteY)            \
+    X(0x81, STA, IndirectX)            \
+    X(0x91, STA, IndirectY)            \
+                                       \
+    /* STX */                          \
+    X(0x86, STX, ZeroPage)             \
+    X(0x96, STX, ZeroPageY)            \
+    X(0x8E, STX, Absolute)             \
+                                       \
+    /* STY */                          \
+    X(0x84, STY, ZeroPage)             \
+    X(0x94, STY, ZeroPageX)            \
+    X(0x8C, STY, Absolute)             \
+                                       \
+    /* TAX, TAY, TSX, TXA, TXS, TYA */ \
+    X(0xAA, TAX, Implicit)             \
+    X(0xA8, TAY, Implicit)             \
+    X(0xBA, TSX, Implicit)             \
+    X(0x8A, TXA, Implicit)             \
+    X(0x9A, TXS, Implicit)             \
+    X(0x98, TYA, Implicit)             \
+                                       \
+    /* Add instructions */             \
+    X(0x4C, JMP, Absolute)             \
+    X(0x6C, JMP, IndirectJMP)          \
+    X(0x20, JSR, Absolute)             \
+    X(0x60, RTS, Implicit)             \
+    X(0x00, BRK, Implicit)             \
+    X(0x40, RTI, Implicit)             \
+    X(0x48, PHA, Implicit)             \
+    X(0x68, PLA, Implicit)             \
+    X(0x08, PHP, Implicit)             \
+    X(0x28, PLP, Implicit)             \
+    X(0x58, CLI, Implicit)             \
+    X(0x78, SEI, Implicit)             \
+    X(0xF0, BEQ, Relative)             \
+    X(0xD0, BNE, Relative)             \
+    X(0x90, BCC, Relative)             \
+    X(0xB0, BCS, Relative)             \
+    X(0x30, BMI, Relative)             \
+    X(0x10, BPL, Relative)             \
+    X(0x50, BVC, Relative)             \
+    X(0x70, BVS, Relative)             \
+    X(0x18, CLC, Implicit)             \
+    X(0x38, SEC, Implicit)             \
+    X(0x0A, ASL, Accumulator)          \
+    X(0x06, ASL, ZeroPage)             \
+    X(0x16, ASL, ZeroPageX)            \
+    X(0x0E, ASL, Absolute)             \
+    X(0x1E, ASL, AbsoluteX)            \
+    X(0x4A, LSR, Accumulator)          \
+    X(0x46, LSR, ZeroPage)             \
+    X(0x56, LSR, ZeroPageX)            \
+    X(0x4E, LSR, Absolute)             \
+    X(0x5E, LSR, AbsoluteX)            \
+    X(0x2A, ROL, Accumulator)          \
+    X(0x26, ROL, ZeroPage)             \
+    X(0x36, ROL, ZeroPageX)            \
+    X(0x2E, ROL, Absolute)             \
+    X(0x3E, ROL, AbsoluteX)            \
+    X(0x6A, ROR, Accumulator)          \
+    X(0x66, ROR, ZeroPage)             \
+    X(0x76, ROR, ZeroPageX)            \
+    X(0x6E, ROR, Absolute)             \
+    X(0x7E, ROR, AbsoluteX)            \
+    X(0xC9, CMP, Immediate)            \
+    X(0xC5, CMP, ZeroPage)             \
+    X(0xD5, CMP, ZeroPageX)            \
+    X(0xCD, CMP, Absolute)             \
+    X(0xDD, CMP, AbsoluteX)            \
+    X(0xD9, CMP, AbsoluteY)            \
+    X(0xC1, CMP, IndirectX)            \
+    X(0xD1, CMP, IndirectY)            \
+    X(0xE0, CPX, Immediate)            \
+    X(0xE4, CPX, ZeroPage)             \
+    X(0xEC, CPX, Absolute)             \
+    X(0xC0, CPY, Immediate)            \
+    X(0xC4, CPY, ZeroPage)             \
+    X(0xCC, CPY, Absolute)             \
+    X(0xEA, NOP, Implicit)             \
+    X(0xD8, CLD, Implicit)             \
+    X(0xF8, SED, Implicit)             \
+    X(0xB8, CLV, Implicit)             \
+    X(0x69, ADC, Immediate)            \
+    X(0x65, ADC, ZeroPage)             \
+    X(0x75, ADC, ZeroPageX)            \
+    X(0x6D, ADC, Absolute)             \
+    X(0x7D, ADC, AbsoluteX)            \
+    X(0x79, ADC, AbsoluteY)            \
+    X(0x61, ADC, IndirectX)            \
+    X(0x71, ADC, IndirectY)            \
+    X(0xE9, SBC, Immediate)            \
+    X(0xE5, SBC, ZeroPage)             \
+    X(0xF5, SBC, ZeroPageX)            \
+    X(0xED, SBC, Absolute)             \
+    X(0xFD, SBC, AbsoluteX)            \
+    X(0xF9, SBC, AbsoluteY)            \
+    X(0xE1, SBC, IndirectX)            \
+    X(0xF1, SBC, IndirectY)            \
+    X(0x24, BIT, ZeroPage)             \
+    X(0x2C, BIT, Absolute)             \
+    X(0x29, AND, Immediate)            \
+    X(0x25, AND, ZeroPage)             \
+    X(0x35, AND, ZeroPageX)            \
+    X(0x2D, AND, Absolute)             \
+    X(0x3D, AND, AbsoluteX)            \
+    X(0x39, AND, AbsoluteY)            \
+    X(0x21, AND, IndirectX)            \
+    X(0x31, AND, IndirectY)            \
+    X(0x09, ORA, Immediate)            \
+    X(0x05, ORA, ZeroPage)             \
+    X(0x15, ORA, ZeroPageX)            \
+    X(0x0D, ORA, Absolute)             \
+    X(0x1D, ORA, AbsoluteX)            \
+    X(0x19, ORA, AbsoluteY)            \
+    X(0x01, ORA, IndirectX)            \
+    X(0x11, ORA, IndirectY)            \
+    X(0x49, EOR, Immediate)            \
+    X(0x45, EOR, ZeroPage)             \
+    X(0x55, EOR, ZeroPageX)            \
+    X(0x4D, EOR, Absolute)             \
+    X(0x5D, EOR, AbsoluteX)            \
+    X(0x59, EOR, AbsoluteY)            \
+    X(0x41, EOR, IndirectX)            \
+    X(0x51, EOR, IndirectY)            \
+    X(0xC8, INY, Implicit)             \
+    X(0xE8, INX, Implicit)             \
+    X(0x88, DEY, Implicit)             \
+    X(0xCA, DEX, Implicit)             \
+    X(0xE6, INC, ZeroPage)             \
+    X(0xF6, INC, ZeroPageX)            \
+    X(0xEE, INC, Absolute)             \
+    X(0xFE, INC, AbsoluteX)            \
+    X(0xC6, DEC, ZeroPage)             \
+    X(0xD6, DEC, ZeroPageX)            \
+    X(0xCE, DEC, Absolute)             \
+    X(0xDE, DEC, AbsoluteX)            \
+                                       \
+    /* Unofficial Opcodes */           \
+    /* SLO */                          \
+    X(0x07, SLO, ZeroPage)             \
+    X(0x17, SLO, ZeroPageX)            \
+    X(0x03, SLO, IndirectX)            \
+    X(0x13, SLO, IndirectY)            \
+    X(0x0F, SLO, Absolute)             \
+    X(0x1F, SLO, AbsoluteX)            \
+    X(0x1B, SLO, AbsoluteY)            \
+                                       \
+    /* RLA */                          \
+    X(0x27, RLA, ZeroPage)             \
+    X(0x37, RLA, ZeroPageX)            \
+    X(0x23, RLA, IndirectX)            \
+    X(0x33, RLA, IndirectY)            \
+    X(0x2F, RLA, Absolute)             \
+    X(0x3F, RLA, AbsoluteX)            \
+    X(0x3B, RLA, AbsoluteY)            \
+                                       \
+    /* SRE */                          \
+    X(0x47, SRE, ZeroPage)             \
+    X(0x57, SRE, ZeroPageX)            \
+    X(0x43, SRE, IndirectX)            \
+    X(0x53, SRE, IndirectY)            \
+    X(0x4F, SRE, Absolute)             \
+    X(0x5F, SRE, AbsoluteX)            \
+    X(0x5B, SRE, AbsoluteY)            \
+                                       \
+    /* RRA */                          \
+    X(0x67, RRA, ZeroPage)             \
+    X(0x77, RRA, ZeroPageX)            \
+    X(0x63, RRA, IndirectX)            \
+    X(0x73, RRA, IndirectY)            \
+    X(0x6F, RRA, Absolute)             \
+    X(0x7F, RRA, AbsoluteX)            \
+    X(0x7B, RRA, AbsoluteY)            \
+                                       \
+    /* SAX */                          \
+    X(0x87, SAX, ZeroPage)             \
+    X(0x97, SAX, ZeroPageY)            \
+    X(0x83, SAX, IndirectX)            \
+    X(0x8F, SAX, Absolute)             \
+                                       \
+    /* LAX */                          \
+    X(0xA7, LAX, ZeroPage)             \
+    X(0xB7, LAX, ZeroPageY)            \
+    X(0xA3, LAX, IndirectX)            \
+    X(0xB3, LAX, IndirectY)            \
+    X(0xAF, LAX, Absolute)             \
+    X(0xBF, LAX, AbsoluteY)            \
+                                       \
+    /* DCP */                          \
+    X(0xC7, DCP, ZeroPage)             \
+    X(0xD7, DCP, ZeroPageX)            \
+    X(0xC3, DCP, IndirectX)            \
+    X(0xD3, DCP, IndirectY)            \
+    X(0xCF, DCP, Absolute)             \
+    X(0xDF, DCP, AbsoluteX)            \
+    X(0xDB, DCP, AbsoluteY)            \
+                                       \
+    /* ISC */                          \
+    X(0xE7, ISC, ZeroPage)             \
+    X(0xF7, ISC, ZeroPageX)            \
+    X(0xE3, ISC, IndirectX)            \
+    X(0xF3, ISC, IndirectY)            \
+    X(0xEF, ISC, Absolute)             \
+    X(0xFF, ISC, AbsoluteX)            \
+    X(0xFB, ISC, AbsoluteY)            \
+                                       \
+    /* ANC */                          \
+    X(0x0B, ANC, Immediate)            \
+    X(0x2B, ANC, Immediate)            \
+                                       \
+    /* ALR */                          \
+    X(0x4B, ALR, Immediate)            \
+                                       \
+    /* ARR */                          \
+    X(0x6B, ARR, Immediate)            \
+                                       \
+    /* AXS */                          \
+    X(0xCB, AXS, Immediate)            \
+                                       \
+    /* SBC Unofficial */               \
+    X(0xEB, SBC, Immediate)            \
+                                       \
+    /* NOP */                          \
+    X(0x04, NOP, ZeroPage)             \
+    X(0x44, NOP, ZeroPageY)            \
+    X(0x64, NOP, ZeroPageX)            \
+    X(0x0C, NOP, Absolute)             \
+    X(0x14, NOP, IndirectX)            \
+    X(0x34, NOP, IndirectX)            \
+    X(0x54, NOP, IndirectX)            \
+    X(0x74, NOP, IndirectX)            \
+    X(0xD4, NOP, IndirectX)            \
+    X(0xF4, NOP, IndirectX)            \
+    X(0x1A, NOP, Implicit)             \
+    X(0x3A, NOP, Implicit)             \
+    X(0x5A, NOP, Implicit)             \
+    X(0x7A, NOP, Implicit)             \
+    X(0xDA, NOP, Implicit)             \
+    X(0xFA, NOP, Implicit)             \
+    X(0x80, NOP, IndirectX)            \
+    X(0x1C, NOP, Absolute)             \
+    X(0x3C, NOP, Absolute)             \
+    X(0x5C, NOP, Absolute)             \
+    X(0x7C, NOP, Absolute)             \
+    X(0xDC, NOP, Absolute)             \
+    X(0xFC, NOP, Absolute)
+
+// ---------------------------------------------------------------------------- //
+// ------------------------------- OPCODE TABLE ------------------------------- //
+// ---------------------------------------------------------------------------- //
+
+struct OpcodeInfo {
+    const char* mnemonic;
+    Op op;
+    AddrMode mode;
+    Access access;
+    uint8_t bytes;              // Instruction length including the opcode
+    uint8_t cycles;             // Cycles without page-cross or taken-branch penalties
+    uint8_t pageCrossPenalty;
+    bool valid;
+};
+
+constexpr OpcodeInfo makeOpcodeInfo(Op op, AddrMode mode) {
+    const AddrModeInfo& m = modeInfo(mode);
+    const OperationInfo& o = operationInfo(op);
+    int cycles = m.cycles + (m.addsOpCycles ? o.cycles : 0);
+    // Accumulator shifts never touch memory
+    Access access = (mode == AddrMode::Accumulator) ? Access::None : o.access;
+    return {o.mnemonic, op, mode, access, static_cast<uint8_t>(1 + m.operandBytes),
+            static_cast<uint8_t>(cycles), m.pageCrossPenalty, true};
+}
+
+constexpr std::array<OpcodeInfo, 256> makeOpcodeTable() {
+    std::array<OpcodeInfo, 256> table{};
+    for (auto& entry : table) {
+        entry = {"???", Op::Invalid, AddrMode::Implicit, Access::None, 1, 2, 0, false};
+    }
+#define X(opcode, op, mode) table[opcode] = makeOpcodeInfo(Op::op, AddrMode::mode);
+    CPU_OPCODES(X)
+#undef X
+    return table;
+}
+
+inline constexpr std::array<OpcodeInfo, 256> OPCODE_TABLE = makeOpcodeTable();
+
+// Conditional branches, which cost a cycle more when taken and another on a page cross
+constexpr bool isBranch(Op op) {
+    return op == Op::BCC || op == Op::BCS || op == Op::BEQ || op == Op::BNE ||
+           op == Op::BMI || op == Op::BPL || op == Op::BVC || op == Op::BVS;
+}
+
+// Most cycles the instruction can take
+constexpr int worstCaseCycles(const OpcodeInfo& info) {
+    return info.cycles + info.pageCrossPenalty + (isBranch(info.op) ? 2 : 0);
+}
+
+// A few spot checks against the 6502 reference timings
+static_assert(OPCODE_TABLE[0xA9].cycles == 2 && OPCODE_TABLE[0xA9].bytes == 2);   // LDA #imm
+static_assert(OPCODE_TABLE[0x4C].cycles == 3 && OPCODE_TABLE[0x4C].bytes == 3);   // JMP abs
+static_assert(OPCODE_TABLE[0x20].cycles == 6);                                    // JSR
+static_assert(OPCODE_TABLE[0x00].cycles == 7);                                    // BRK
+static_assert(OPCODE_TABLE[0xB1].pageCrossPenalty == 1);                          // LDA (zp),Y
+static_assert(OPCODE_TABLE[0xE6].access == Access::ReadModifyWrite);              // INC zp
+
+#endif // OPCODES_H
@@ -2,9 +2,11 @@
 #include <cstdint>
 #include <cstdlib>
 #include <array>
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include "PPU.h"
+#include "PixelMux.h"
 
 #include <thread>
 #include <unistd.h>
@@ -13,6 +15,15 @@
 
 void PPU::cpuWrite(uint16_t addr, uint8_t data) {
     //printf("PPU::cpuWrite(%04x, %04x)\n", addr, data);
+    // $2004 is logged by writeOAM
+    if (recording() && addr != 0x0004) {
+        if (addr == 0x0007) {
+            deferredRenderer->log(*this, DeferredRenderer::VRAM_WRITE, v.vram_register & 0x3FFF, data);
+        }
+        else {
+            deferredRenderer->log(*this, DeferredRenderer::REGISTER_WRITE, addr, data);
+        }
+    }
     switch (addr) {
         case 0x0000: // CRTL
             control.reg = data;
@@ -21,6 +32,7 @@ void PPU::cpuWrite(uint16_t addr, uint8_t data) {
             break;
         case 0x0001: // MASK
             mask.reg = data;
+            paletteDirty = true;
             break;
         case 0x0002: // STATUS
             break;
@@ -28,7 +40,7 @@ void PPU::cpuWrite(uint16_t addr, uint8_t data) {
             OAMADDR = data;
             break;
         case 0x0004: // OAM Data
-            OAMDATA[OAMADDR] = data;
+            writeOAM(OAMADDR, data);
             // This is maybe a fix from running PPU test roms
             OAMADDR++;
             break;
@@ -70,6 +82,9 @@ void PPU::cpuWrite(uint16_t addr, uint8_t data) {
 
 uint8_t PPU::cpuRead(uint16_t address) {
     uint8_t return_data = 0x00;
+    if (recording() && (address == 0x0002 || address == 0x0007)) {
+        deferredRenderer->log(*this, DeferredRenderer::REGISTER_READ, address, 0);
+    }
     switch(address) {
         case 0x0000: // Control register, not readable
             break;
@@ -107,40 +122,10 @@ void PPU::writePPU(uint16_t addr, uint8_t data) {
     addr &= 0x3FFF;
     if (addr >= 0x000 && addr <= 0x1FFF) {
         patternTables[addr] = data;
+        tileDirty[addr >> 4] = true;
     }
     else if (addr >= 0x2000 && addr <= 0x3EFF) {
-
-        addr &= 0x0FFF;
-        // Vertical mirror
-        if (ROM->ROMheader.flags6 == 1) {
-            if (addr >= 0x0000 && addr <= 0x03FF) {
-                nameTables[addr & 0x03FF] = data;
-            }
-            if (addr >= 0x0400 && addr <= 0x07FF) {
-                nameTables[(addr & 0x03FF) + 1024] = data;
-            }
-            if (addr >= 0x0800 && addr <= 0x0BFF) {
-                nameTables[addr & 0x03FF] = data;
-            }
-            if (addr >= 0x0C00 && addr <= 0x0FFF) {
-                nameTables[(addr & 0x03FF) + 1024] = data;
-            }
-        }
-        // Horizontal mirror
-        if (ROM->ROMheader.flags6 == 0) {
-            if (addr >= 0x0000 && addr <= 0x03FF) {
-                nameTables[addr & 0x03FF] = data;
-            }
-            if (addr >= 0x0400 && addr <= 0x07FF) {
-                nameTables[addr & 0x03FF] = data;
-            }
-            if (addr >= 0x0800 && addr <= 0x0BFF) {
-                nameTables[(addr & 0x03FF) + 1024] = data;
-            }
-            if (addr >= 0x0C00 && addr <= 0x0FFF) {
-                nameTables[(addr & 0x03FF) + 1024] = data;
-            }
-        }
+        nameTableByte(addr) = data;
     }
     else if (addr >= 0x3F00 && addr <= 0x3FFF) {
         addr &= 0x001F;
@@ -149,6 +134,7 @@ void PPU::writePPU(uint16_t addr, uint8_t data) {
         if (addr == 0x0018) addr = 0x0008;
         if (addr == 0x001C) addr = 0x000C;
         paletteMemory[addr] = data;
+        paletteDirty = true;
     }
 }
 
@@ -161,38 +147,7 @@ uint8_t PPU::readPPU(uint16_t addr) {
         return data;
     }
     else if (addr >= 0x2000 && addr <= 0x3EFF) {
-        addr &= 0x0FFF;
-        // Vertical mirror
-        if (ROM->ROMheader.flags6 == 1) {
-            if (addr >= 0x0000 && addr <= 0x03FF) {
-                data = nameTables[addr & 0x03FF];
-            }
-            if (addr >= 0x0400 && addr <= 0x07FF) {
-                data = nameTables[(addr & 0x03FF) + 0x0400];
-            }
-            if (addr >= 0x0800 && addr <= 0x0BFF) {
-                data = nameTables[addr & 0x03FF];
-            }
-            if (addr >= 0x0C00 && addr <= 0x0FFF) {
-                data = nameTables[(addr & 0x03FF) + 0x0400];
-            }
-        }
-        // Horizontal mirror
-        if (ROM->ROMheader.flags6 == 0) {
-            if (addr >= 0x0000 && addr <= 0x03FF) {
-                data = nameTables[addr & 0x03FF];
-            }
-            if (addr >= 0x0400 && addr <= 0x07FF) {
-                data = nameTables[addr & 0x03FF];
-            }
-            if (addr >= 0x0800 && addr <= 0x0BFF) {
-                data = nameTables[(addr & 0x03FF) + 0x0400];
-            }
-            if (addr >= 0x0C00 && addr <= 0x0FFF) {
-                data = nameTables[(addr & 0x03FF) + 0x0400];
-            }
-        }
-        return data;
+        return nameTableByte(addr);
     }
     else if (addr >= 0x3F00 && addr <= 0x3FFF) {
         addr &= 0x001F;
@@ -204,8 +159,28 @@ uint8_t PPU::readPPU(uint16_t addr) {
     }
 }
 
+PPU::~PPU() = default;
+
 void PPU::connectROM(NESROM& ROM) {
     this->ROM = &ROM;
+    setMirroring(ROM.mirroring);
+}
+
+void PPU::setMirroring(NESROM::Mirroring mirroring) {
+    if (recording()) {
+        deferredRenderer->log(*this, DeferredRenderer::MIRRORING, 0, mirroring);
+    }
+    this->mirroring = mirroring;
+    static constexpr uint8_t PAGES[5][4] = {
+        {0, 0, 1, 1},   // HORIZONTAL
+        {0, 1, 0, 1},   // VERTICAL
+        {0, 0, 0, 0},   // SINGLE_SCREEN_LOW
+        {1, 1, 1, 1},   // SINGLE_SCREEN_HIGH
+        {0, 1, 2, 3}    // FOUR_SCREEN
+    };
+    for (int i = 0; i < 4; i++) {
+        nameTablePages[i] = &nameTables[PAGES[mirroring][i] * 0x0400];
+    }
 }
 
 // Pattern tables ----------------------------------------------------------------------------------------------------
@@ -216,7 +191,48 @@ uint8_t PPU::readPatternTable(uint16_t addr) {
 }
 
 void PPU::writePatternTable(uint16_t addr, uint8_t data) {
+    if (recording()) {
+        deferredRenderer->log(*this, DeferredRenderer::PATTERN_WRITE, addr, data);
+    }
     patternTables[addr] = data;
+    tileDirty[(addr >> 4) & 0x1FF] = true;
+}
+
+static uint8_t flipByte(uint8_t b) {
+    b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+    b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+    b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+    return b;
+}
+
+uint64_t PPU::decodeRow(uint8_t lo, uint8_t hi) {
+    uint64_t pixels = 0;
+    for (int i = 0; i < 8; i++) {
+        uint64_t pixel = (((hi >> (7 - i)) & 1) << 1) | ((lo >> (7 - i)) & 1);
+        pixels |= pixel << (i * 8);
+    }
+    return pixels;
+}
+
+const PPU::TileRow& PPU::tileRow(uint16_t addr) {
+    uint16_t tile = addr >> 4;
+    if (tileDirty[tile]) {
+        for (int row = 0; row < 8; row++) {
+            TileRow& decoded = tileRows[tile * 8 + row];
+            decoded.lo = patternTables[tile * 16 + row];
+            decoded.hi = patternTables[tile * 16 + row + 8];
+            decoded.flippedLo = flipByte(decoded.lo);
+            decoded.flippedHi = flipByte(decoded.hi);
+            decoded.pixels = decodeRow(decoded.lo, decoded.hi);
+            decoded.flippedPixels = decodeRow(decoded.flippedLo, decoded.flippedHi);
+        }
+        tileDirty[tile] = false;
+    }
+    return tileRows[tile * 8 + (addr & 0x07)];
+}
+
+void PPU::invalidateTiles() {
+    tileDirty.fill(true);
 }
 
 void PPU::printPatternTable() {
@@ -320,18 +336,18 @@ void PPU::displayPatternTableOnScreen() {
         current_tile = 0;
     }
     //u_int8_t current_palette = readPPU(0x3F00 + (4 << 2) + current_tile) & 0x3F;
-    uint32_t current_color;
+    uint16_t current_color;
     if (current_tile == 3) {
-        current_color = getColor(22);
+        current_color = 22;
     }
     else if (current_tile == 2) {
-        current_color = getColor(14);
+        current_color = 14;
     }
     else if (current_tile == 1) {
-        current_color = getColor(32);
+        current_color = 32;
     }
     else {
-        current_color = getColor(1);
+        current_color = 1;
     }
     //uint32_t current_color = getColor(current_palette);
     //printf("Current color %08x \n", current_palette);
@@ -342,27 +358,58 @@ void PPU::displayNameTableOnScreen(uint8_t table) {
     uint8_t nameTableByte = nameTables[(table * 1024) + ((scanline / 8) * 32) + (cycle / 8)];
 
     uint8_t current_tile = patternTablesDecoded[(nameTableByte * 64) + ((scanline * 8) % 64) + (cycle % 8) + (control.background_pattern * 16384)];
-    uint32_t current_color;
+    uint16_t current_color;
 
-    current_color = getColor(readPPU(0x3F00 + (0 << 2) + current_tile) % 64);
+    current_color = readPPU(0x3F00 + (0 << 2) + current_tile) % 64;
 
     setPixel(cycle, scanline, current_color);
 }
 
 
-void PPU::setPixel(uint8_t x, uint8_t y, uint32_t color) {
-    rgbFramebuffer[y * 256 + x] = 0xFF000000 | color;
+void PPU::setPixel(uint8_t x, uint8_t y, uint16_t pixel) {
+    framebuffer[y * 256 + x] = pixel;
+}
+
+// System palette, 0xBBGGRR
+static constexpr uint32_t NES_PALETTE[64] = {
+    0x545454, 0xB41D01, 0xA01008, 0x880030, 0x4C0044, 0x20005C, 0x000454, 0x00183C, 0x002A20, 0x003A08, 0x004000, 0x0A3C00, 0x383200, 0x000000, 0x000000, 0x000000,
+    0x969698, 0x644C07, 0xEC3230, 0xEC1E5C, 0xB01488, 0x6414A0, 0x0000FF, 0x0A3C78, 0x003C22, 0x00660A, 0x006400, 0x3A5800, 0x3B3900, 0x2A1B00, 0x1F1F1F, 0x111111,
+    0xA9A9A9, 0x9C3C02, 0xCC4924, 0xCF403E, 0x996C6B, 0xAA777F, 0xC2958B, 0x009EFA, 0xA000FF, 0x00EB74, 0x4E1A8C, 0x531D80, 0xF7D52B, 0x6E4A9E, 0x525192, 0x534E77,
+    0xFFFFFF, 0xE89D0B, 0xE0672F, 0xFF7F6A, 0xF2B9A2, 0xDBC69C, 0x70A5E9, 0xC7825C, 0x990F08, 0xF6D113, 0xFDC835, 0x9E8F7F, 0xF5E0C8, 0xFFFBF3, 0xFFEBC8, 0xF79F7F
+};
+
+// Emphasis darkens the channels that aren't emphasized to 3/4
+static constexpr std::array<uint32_t, 512> buildEmphasisPalettes() {
+    std::array<uint32_t, 512> palettes{};
+    for (int emphasis = 0; emphasis < 8; emphasis++) {
+        for (int i = 0; i < 64; i++) {
+            uint32_t color = 0xFF000000;
+            for (int channel = 0; channel < 3; channel++) {
+                uint32_t value = (NES_PALETTE[i] >> (channel * 8)) & 0xFF;
+                if (emphasis != 0 && !(emphasis & (1 << channel))) {
+                    value = value * 3 / 4;
+                }
+                color |= value << (channel * 8);
+            }
+            palettes[emphasis * 64 + i] = color;
+        }
+    }
+    return palettes;
 }
 
+const std::array<uint32_t, 512> PPU::EMPHASIS_PALETTES = buildEmphasisPalettes();
+
 unsigned PPU::getColor(int index) {
-    std::array<uint32_t, 64> nesPalette = {
-        0x545454, 0xB41D01, 0xA01008, 0x880030, 0x4C0044, 0x20005C, 0x000454, 0x00183C, 0x002A20, 0x003A08, 0x004000, 0x0A3C00, 0x383200, 0x000000, 0x000000, 0x000000,
-        0x969698, 0x644C07, 0xEC3230, 0xEC1E5C, 0xB01488, 0x6414A0, 0x0000FF, 0x0A3C78, 0x003C22, 0x00660A, 0x006400, 0x3A5800, 0x3B3900, 0x2A1B00, 0x1F1F1F, 0x111111,
-        0xA9A9A9, 0x9C3C02, 0xCC4924, 0xCF403E, 0x996C6B, 0xAA777F, 0xC2958B, 0x009EFA, 0xA000FF, 0x00EB74, 0x4E1A8C, 0x531D80, 0xF7D52B, 0x6E4A9E, 0x525192, 0x534E77,
-        0xFFFFFF, 0xE89D0B, 0xE0672F, 0xFF7F6A, 0xF2B9A2, 0xDBC69C, 0x70A5E9, 0xC7825C, 0x990F08, 0xF6D113, 0xFDC835, 0x9E8F7F, 0xF5E0C8, 0xFFFBF3, 0xFFEBC8, 0xF79F7F
-    };
+    return EMPHASIS_PALETTES[index];
+}
 
-    return 0xFF000000 | nesPalette[index];
+void PPU::updatePaletteColors() {
+    // readPPU applies the palette mirrors and grayscale
+    uint16_t emphasis = (mask.reg >> 5) << 6;
+    for (int i = 0; i < 32; i++) {
+        paletteColors[i] = emphasis | (readPPU(0x3F00 + i) % 64);
+    }
+    paletteDirty = false;
 }
 
 void PPU::shiftLeft(uint8_t arr[], int size) {
@@ -420,12 +467,110 @@ void PPU::reset() {
     cycle = 0;
     status.reg = 0x00;
     mask.reg = 0x00;
+    paletteDirty = true;
     control.reg = 0x00;
     v.vram_register = 0x0000;
     t.vram_register = 0x0000;
 
 }
 
+// Increments the coarse x in the vram during rendering.
+void PPU::incrementScrollX() {
+    // Check if rendering is enabled
+    if (mask.enable_background_rendering || mask.enable_sprite_rendering) {
+        // if the coarse x is at the end of the table, wrap around and go to the next table
+        if (v.coarse_x == 31) {
+            v.coarse_x = 0;
+            v.nametable_x = ~v.nametable_x;
+        }
+        // Otherwise increment
+        else {
+            v.coarse_x++;
+        }
+    }
+}
+
+void PPU::loadShiftRegisters() {
+    bg_shifter_tile_lo = (bg_shifter_tile_lo & 0xFF00 | (next_bg_tile_lsb));
+    bg_shifter_tile_hi = (bg_shifter_tile_hi & 0xFF00 | (next_bg_tile_msb));
+    bg_shifter_attribute_lo  = (bg_shifter_attribute_lo  & 0xFF00) | ((next_bg_tile_attribute & 0b01) ? 0xFF : 0x00);
+    bg_shifter_attribute_hi  = (bg_shifter_attribute_hi  & 0xFF00) | ((next_bg_tile_attribute & 0b10) ? 0xFF : 0x00);
+    for (int i = 0; i < 8; ++i) {
+        arr[7+i] = (next_bg_tile_attribute);
+    }
+}
+
+// Background tile fetches, one every other dot of each 8 dot tile
+void PPU::fetchTileId() {
+    next_bg_tile_id = nameTableByte(v.vram_register);
+}
+
+void PPU::fetchTileAttribute() {
+    next_bg_tile_attribute = nameTableByte(0x23C0 | (v.nametable_y << 11)
+        | (v.nametable_x << 10)
+        | ((v.coarse_y >> 2) << 3)
+        | (v.coarse_x >> 2));
+    if (v.coarse_y & 0x02) next_bg_tile_attribute >>= 4;
+    if (v.coarse_x & 0x02) next_bg_tile_attribute >>=2;
+    next_bg_tile_attribute &=0x03;
+}
+
+const PPU::TileRow& PPU::backgroundTileRow() {
+    return tileRow((control.background_pattern * 4096) + (next_bg_tile_id * 16) + v.fine_y);
+}
+
+void PPU::fetchTileLsb() {
+    next_bg_tile_lsb = backgroundTileRow().lo;
+}
+
+void PPU::fetchTileMsb() {
+    next_bg_tile_msb = backgroundTileRow().hi;
+}
+
+void PPU::writeOAM(uint8_t addr, uint8_t data) {
+    if (recording()) {
+        deferredRenderer->log(*this, DeferredRenderer::OAM_WRITE, addr, data);
+    }
+    OAMDATA[addr] = data;
+    spriteBucketsDirty = true;
+}
+
+// Sorts the sprites into the scanlines they cover, in OAM order, keeping the first 8 of
+// each line and counting the rest
+void PPU::buildSpriteBuckets() {
+    uint8_t height = control.sprite_size ? 16 : 8;
+    std::memset(spriteBucketCount, 0, sizeof(spriteBucketCount));
+    for (uint8_t i = 0; i < 64; i++) {
+        for (int line = OAM[i].y; line < OAM[i].y + height && line < 261; line++) {
+            if (spriteBucketCount[line] < 8) {
+                spriteBuckets[line][spriteBucketCount[line]] = i;
+            }
+            spriteBucketCount[line]++;
+        }
+    }
+    spriteBucketHeight = height;
+    spriteBucketsDirty = false;
+}
+
+void PPU::evaluateSprites() {
+    if (spriteBucketsDirty || spriteBucketHeight != (control.sprite_size ? 16 : 8)) {
+        buildSpriteBuckets();
+    }
+
+    std::memset(spriteScanline, 0xFF, 8 * sizeof(ObjectAttributeMemory));
+    uint8_t inRange = spriteBucketCount[scanline];
+    numOfSprites = inRange < 8 ? inRange : 8;
+    for (uint8_t i = 0; i < numOfSprites; i++) {
+        spriteScanline[i] = OAM[spriteBuckets[scanline][i]];
+    }
+    // Check if next scanline contains a sprite zero
+    bSpriteZeroHitPossible = numOfSprites > 0 && spriteBuckets[scanline][0] == 0;
+    // Stays set until the pre-render line
+    if (inRange > 8) {
+        status.sprite_overflow = 1;
+    }
+}
+
 void PPU::clock() {
     // Debugging tools
     if (scanline < 241 && cycle < 256) {
@@ -436,22 +581,6 @@ void PPU::clock() {
         //printf("\n");
     }
 
-    // Increments the coarse x in the vram during rendering.
-    auto IncrementScrollX = [&]() {
-        // Check if rendering is enabled
-        if (mask.enable_background_rendering || mask.enable_sprite_rendering) {
-            // if the coarse x is at the end of the table, wrap around and go to the next table
-            if (v.coarse_x == 31) {
-                v.coarse_x = 0;
-                v.nametable_x = ~v.nametable_x;
-            }
-            // Otherwise increment
-            else {
-                v.coarse_x++;
-            }
-        }
-    };
-
     // Increment fine y  and coarse y during rendering
     auto IncrementScrollY = [&]() {
         if (mask.enable_background_rendering || mask.enable_sprite_rendering) {
@@ -473,16 +602,6 @@ void PPU::clock() {
             }
         }
     };
-    auto loadShiftRegisters = [&]() {
-        bg_shifter_tile_lo = (bg_shifter_tile_lo & 0xFF00 | (next_bg_tile_lsb));
-        bg_shifter_tile_hi = (bg_shifter_tile_hi & 0xFF00 | (next_bg_tile_msb));
-        bg_shifter_attribute_lo  = (bg_shifter_attribute_lo  & 0xFF00) | ((next_bg_tile_attribute & 0b01) ? 0xFF : 0x00);
-        bg_shifter_attribute_hi  = (bg_shifter_attribute_hi  & 0xFF00) | ((next_bg_tile_attribute & 0b10) ? 0xFF : 0x00);
-        for (int i = 0; i < 8; ++i) {
-            arr[7+i] = (next_bg_tile_attribute);
-        }
-    };
-
     auto updateShifters = [&]() {
         if (mask.enable_background_rendering) {
             bg_shifter_tile_lo <<= 1;
@@ -541,26 +660,20 @@ void PPU::clock() {
 
             if (action == 0) {
                 loadShiftRegisters();
-                next_bg_tile_id = readPPU(0x2000 | (v.vram_register & 0x0FFF));
+                fetchTileId();
 
             }
             else if (action == 2) {
-                next_bg_tile_attribute = readPPU(0x23C0 | (v.nametable_y << 11)
-                    | (v.nametable_x << 10)
-                    | ((v.coarse_y >> 2) << 3)
-                    | (v.coarse_x >> 2));
-                if (v.coarse_y & 0x02) next_bg_tile_attribute >>= 4;
-                if (v.coarse_x & 0x02) next_bg_tile_attribute >>=2;
-                next_bg_tile_attribute &=0x03;
+                fetchTileAttribute();
             }
             else if (action == 4) {
-                next_bg_tile_lsb = readPPU((control.background_pattern * 4096) + (next_bg_tile_id * 16) + v.fine_y);
+                fetchTileLsb();
             }
             else if(action == 6) {
-                next_bg_tile_msb = readPPU((control.background_pattern * 4096) + (next_bg_tile_id * 16) + v.fine_y + 8);
+                fetchTileMsb();
             }
             else if(action == 7) {
-                IncrementScrollX();
+                incrementScrollX();
             }
         }
 
@@ -583,26 +696,7 @@ void PPU::clock() {
 
     // Find out which sprites belong on the next scan line
     if (cycle == 257 && scanline >= 0) {
-        std::memset(spriteScanline, 0xFF, 8 * sizeof(ObjectAttributeMemory));
-        numOfSprites = 0;
-
-        uint8_t OAMEntry = 0;
-        bSpriteZeroHitPossible = false;
-        while (OAMEntry < 64 && numOfSprites < 9) {
-            int16_t diff = ((int16_t)scanline - static_cast<int16_t>(OAM[OAMEntry].y));
-            if (diff >= 0 && diff < (control.sprite_size ? 16 : 8)) {
-                if (numOfSprites < 8) {
-                    // Check if next scanline contains a sprite zero
-                    if (OAMEntry == 0) {
-                        bSpriteZeroHitPossible = true;
-                    }
-                    memcpy(&spriteScanline[numOfSprites], &OAM[OAMEntry], sizeof(ObjectAttributeMemory));
-                    numOfSprites++;
-                }
-            }
-            OAMEntry++;
-        }
-        status.sprite_overflow = (numOfSprites > 8);
+        evaluateSprites();
     }
 
     if (cycle == 340) {
@@ -646,21 +740,22 @@ void PPU::clock() {
                     }
                 }
             }
-            sprite_pattern_addr_hi = sprite_pattern_addr_lo + 8;
-            sprite_pattern_bits_lo = readPPU(sprite_pattern_addr_lo);
-            sprite_pattern_bits_hi = readPPU(sprite_pattern_addr_hi);
-
-            if (spriteScanline[i].attribute & 0x40) {
-                auto flipbyte = [](uint8_t b) {
-                    b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
-                    b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
-                    b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
-                    return b;
-                };
-
-                // Flip sprite horizontally
-                sprite_pattern_bits_lo = flipbyte(sprite_pattern_bits_lo);
-                sprite_pattern_bits_hi = flipbyte(sprite_pattern_bits_hi);
+            bool flipped = spriteScanline[i].attribute & 0x40;
+            if (sprite_pattern_addr_lo < 0x2000) {
+                const TileRow& row = tileRow(sprite_pattern_addr_lo);
+                sprite_pattern_bits_lo = flipped ? row.flippedLo : row.lo;
+                sprite_pattern_bits_hi = flipped ? row.flippedHi : row.hi;
+            }
+            // Sprites left over from the last scanline land outside the pattern tables on
+            // the pre-render line
+            else {
+                sprite_pattern_addr_hi = sprite_pattern_addr_lo + 8;
+                sprite_pattern_bits_lo = readPPU(sprite_pattern_addr_lo);
+                sprite_pattern_bits_hi = readPPU(sprite_pattern_addr_hi);
+                if (flipped) {
+                    sprite_pattern_bits_lo = flipByte(sprite_pattern_bits_lo);
+                    sprite_pattern_bits_hi = flipByte(sprite_pattern_bits_hi);
+                }
             }
 
             sprite_shifter_pattern_lo[i] = sprite_pattern_bits_lo;
@@ -754,8 +849,8 @@ void PPU::clock() {
     }
 
     // Set pixel to screen
-    if (scanline < 241 && cycle < 256) {
-        setPixel(cycle, scanline, getColor(readPPU(0x3F00 + (palette<< 2) + pixel) % 64));
+    if (scanline >= 0 && scanline < 240 && cycle < 256 && !frameTimingOnly) {
+        setPixel(cycle, scanline, paletteColor((palette << 2) + pixel));
     }
 
     // Advance cycle and scanline
@@ -764,12 +859,212 @@ void PPU::clock() {
         cycle = 0;
         scanline++;
 
+        if (recording()) {
+            if (scanline == 0) {
+                deferredRenderer->beginFrame(*this);
+            }
+            deferredRenderer->captureLine(*this);
+        }
+
         if (scanline >= 261) {
             total_frames++;
             scanline = -1;
             complete_frame = true;
 
-            std::memcpy(nextFrame, rgbFramebuffer, sizeof(rgbFramebuffer));
+            if (frameDeferred) {
+                deferredRenderer->render(framebuffer);
+            }
+            if (!frameTimingOnly || frameDeferred) {
+                frames.publish();
+                framebuffer = frames.back();
+            }
+            frameDeferred = renderThreads > 0 && !timingOnly;
+            if (frameDeferred && (!deferredRenderer || deferredRenderer->threads() != renderThreads)) {
+                deferredRenderer = std::make_unique<DeferredRenderer>(renderThreads);
+            }
+            frameTimingOnly = timingOnly || frameDeferred;
+        }
+    }
+    clockCounter++;
+}
+
+// Draws dots 0-255 of a visible scanline in one go and leaves the PPU exactly where running
+// clock() over them would: same pixels, shifters, fetches, scroll and sprite zero hit. Only
+// valid with background rendering on and nothing touching the PPU before dot 256.
+void PPU::renderScanline() {
+    // A timing only frame still needs the pixels where sprite zero could hit
+    bool zeroHitPossible = bSpriteZeroHitPossible && mask.enable_sprite_rendering;
+    bool drawPixels = !frameTimingOnly || zeroHitPossible;
+
+    // Background palette entries, (palette << 2) | pixel. Dot 0 shows the shifters as the
+    // previous line's prefetch left them, every other dot shifts them once first. The tail
+    // has room for the last tile's full 8 byte store.
+    alignas(16) uint8_t bgEntry[256 + 8];
+    bgEntry[0] = (arr[x] << 2) | ((((bg_shifter_tile_hi << x) & 0x8000) >> 15) << 1) | (((bg_shifter_tile_lo << x) & 0x8000) >> 15);
+
+    // One tile per 8 dots: shift and load at its first dot, fetch the next one meanwhile and
+    // increment coarse x at its last. The 32nd tile stops at dot 255.
+    //
+    // The 8 dots of tile n show the tiles fetched two and one tiles earlier, offset by fine
+    // x (with the attribute one dot ahead of the pattern, like arr in clock()). From tile 2
+    // on those are this line's fetches, so their decoded rows are combined 8 pixels at a
+    // time. Tiles 0 and 1 come out of the shifters the previous line's prefetch loaded.
+    uint64_t fetchedPixels[32];
+    uint8_t fetchedAttribute[32];
+    for (int tile = 0; tile < 32; tile++) {
+        int first = tile * 8 + 1;
+        int dots = tile < 31 ? 8 : 7;
+
+        bg_shifter_tile_lo <<= 1;
+        bg_shifter_tile_hi <<= 1;
+        bg_shifter_attribute_lo <<= 1;
+        bg_shifter_attribute_hi <<= 1;
+        shiftLeft(arr, 16);
+        loadShiftRegisters();
+        fetchTileId();
+        fetchTileAttribute();
+        const TileRow& row = backgroundTileRow();
+        next_bg_tile_lsb = row.lo;
+        next_bg_tile_msb = row.hi;
+        fetchedPixels[tile] = row.pixels;
+        fetchedAttribute[tile] = next_bg_tile_attribute;
+
+        if (drawPixels && tile < 2) {
+            uint8_t lo = (bg_shifter_tile_lo << x) >> 8;
+            uint8_t hi = (bg_shifter_tile_hi << x) >> 8;
+            for (int d = 0; d < dots; d++) {
+                bgEntry[first + d] = (arr[x + d] << 2) | (((hi >> (7 - d)) & 1) << 1) | ((lo >> (7 - d)) & 1);
+            }
+        }
+        else if (drawPixels) {
+            uint64_t pixels = fetchedPixels[tile - 2];
+            if (x > 0) {
+                pixels = (pixels >> (x * 8)) | (fetchedPixels[tile - 1] << (64 - x * 8));
+            }
+            uint64_t attributeSplit = (uint64_t(1) << ((7 - x) * 8)) - 1;
+            uint64_t attributes = ((fetchedAttribute[tile - 2] * 0x0101010101010101ull) & attributeSplit)
+                | ((fetchedAttribute[tile - 1] * 0x0101010101010101ull) & ~attributeSplit);
+            uint64_t entries = pixels | (attributes << 2);
+            std::memcpy(bgEntry + first, &entries, sizeof(entries));
+        }
+
+        // The remaining dots of the tile only shift
+        bg_shifter_tile_lo <<= dots - 1;
+        bg_shifter_tile_hi <<= dots - 1;
+        bg_shifter_attribute_lo <<= dots - 1;
+        bg_shifter_attribute_hi <<= dots - 1;
+        for (int d = 1; d < dots; d++) {
+            shiftLeft(arr, 16);
+        }
+        if (tile < 31) {
+            incrementScrollX();
+        }
+    }
+
+    // Sprite line buffer in the layout muxPixels takes. A sprite starts at its x and shifts
+    // once per dot after that, the lowest opaque one wins.
+    alignas(16) uint8_t fgPixel[256]{};
+    if (mask.enable_sprite_rendering) {
+        for (int i = numOfSprites - 1; i >= 0; i--) {
+            uint8_t spriteX = spriteScanline[i].x;
+            uint8_t sprite = (((spriteScanline[i].attribute & 0x03) + 0x04) << 2)
+                | (((spriteScanline[i].attribute & 0x20) == 0) ? SPRITE_FRONT : 0)
+                | (i == 0 ? SPRITE_ZERO : 0);
+            for (int d = 0; d < 8 && spriteX + d < 256; d++) {
+                uint8_t pixel = (((sprite_shifter_pattern_hi[i] >> (7 - d)) & 1) << 1)
+                    | ((sprite_shifter_pattern_lo[i] >> (7 - d)) & 1);
+                if (pixel) {
+                    fgPixel[spriteX + d] = sprite | pixel;
+                }
+            }
+
+            // Where dot 255 leaves the sprite
+            int shifts = 255 - spriteX;
+            sprite_shifter_pattern_lo[i] = shifts < 8 ? sprite_shifter_pattern_lo[i] << shifts : 0;
+            sprite_shifter_pattern_hi[i] = shifts < 8 ? sprite_shifter_pattern_hi[i] << shifts : 0;
+            spriteScanline[i].x = 0;
+        }
+        bSpriteZeroBeingRendered = (fgPixel[255] & SPRITE_ZERO) != 0;
+    }
+
+    if (!drawPixels) {
+        cycle = 256;
+        clockCounter += 256;
+        return;
+    }
+
+    // Same priority rules as clock(), 16 dots at a time. Sprite zero hits count from dot 9.
+    alignas(16) uint8_t entries[256];
+    bool zeroHits = false;
+    for (int dot = 0; dot < 256; dot += 16) {
+        uint16_t hits = muxPixels(bgEntry + dot, fgPixel + dot, entries + dot);
+        zeroHits |= (dot == 0 ? hits & 0xFE00 : hits) != 0;
+    }
+    if (zeroHits && zeroHitPossible) {
+        status.sprite_zerohit = 1;
+    }
+
+    if (!frameTimingOnly) {
+        // Nothing can change the palette during the line
+        if (paletteDirty) {
+            updatePaletteColors();
+        }
+        uint16_t* line = framebuffer + scanline * 256;
+        for (int dot = 0; dot < 256; dot++) {
+            line[dot] = paletteColors[entries[dot]];
+        }
+    }
+
+    cycle = 256;
+    clockCounter += 256;
+}
+
+// Dots 0-255 of a visible scanline with background and sprite rendering both off. Nothing
+// shifts or scrolls, so every fetch repeats the tile at v and the pixel (the top shifter
+// bits) stays put. Only arr[7], which the loads overwrite, can change the palette.
+void PPU::blankScanline() {
+    uint8_t pixel = ((((bg_shifter_tile_hi << x) & 0x8000) >> 15) << 1) | (((bg_shifter_tile_lo << x) & 0x8000) >> 15);
+    uint8_t palette[3];
+    palette[0] = arr[x];                // Dot 0
+    loadShiftRegisters();
+    palette[1] = arr[x];                // Dots 1-8, the tile fetched before this line
+    fetchTileId();
+    fetchTileAttribute();
+    fetchTileLsb();
+    fetchTileMsb();
+    loadShiftRegisters();
+    palette[2] = arr[x];                // Dots 9-255
+
+    if (!frameTimingOnly) {
+        uint16_t color[3];
+        for (int i = 0; i < 3; i++) {
+            color[i] = paletteColor(pixel ? (palette[i] << 2) | pixel : 0x00);
+        }
+        uint16_t* line = framebuffer + scanline * 256;
+        line[0] = color[0];
+        std::fill(line + 1, line + 9, color[1]);
+        std::fill(line + 9, line + 256, color[2]);
+    }
+
+    cycle = 256;
+    clockCounter += 256;
+}
+
+void PPU::catchUp(uint32_t masterCycle) {
+    while (static_cast<int32_t>(masterCycle - clockCounter) > 0) {
+        // A line the CPU can't write to before dot 256 is drawn at once, writes only happen
+        // between catch-ups. Lines with a mid-line write run dot by dot.
+        if (scanlineRenderer && cycle == 0 && scanline >= 0 && scanline < 240
+            && masterCycle - clockCounter >= 256) {
+            if (mask.enable_background_rendering) {
+                renderScanline();
+                continue;
+            }
+            if (!mask.enable_sprite_rendering) {
+                blankScanline();
+                continue;
+            }
         }
+        clock();
     }
 }
\ No newline at end of file
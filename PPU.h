@@ -4,10 +4,14 @@
 #include <cstdint>  // For uint8_t and uint16_t
 #include <map>
 #include "ROM.h"
+#include "TripleBuffer.h"
+#include "DeferredRenderer.h"
+#include <memory>
 #include <array>
 #include <cstring>
 class PPU {
 public:
+    ~PPU();
     // Internal Registers
     union vram {
         struct {
@@ -37,7 +41,7 @@ public:
             uint8_t vblank: 1;
         };
         uint8_t reg;
-    } status;
+    } status{};
 
     union PPUCTRL {
         struct {
@@ -50,7 +54,7 @@ public:
             uint8_t ppu_master: 1;
             uint8_t vblank_nmi_enable: 1;
         }; uint8_t reg;
-    } control;
+    } control{};
 
     union PPUMASK {
         struct {
@@ -64,7 +68,7 @@ public:
             uint8_t emphasize_blue: 1;
         };
         uint8_t reg;
-    } mask;
+    } mask{};
 
     //uint8_t PPUCTRL = 0x00;         // Controller
     //uint8_t PPUMASK = 0x00;         // Mask
@@ -83,7 +87,18 @@ public:
     } OAM[64]{};
 
     ObjectAttributeMemory spriteScanline[8];
-    uint8_t numOfSprites;
+    uint8_t numOfSprites = 0;
+
+    // Sprites by scanline (0-260), built from OAM on the first evaluation after OAM or the
+    // sprite size changed instead of scanning OAM on every line. Set spriteBucketsDirty
+    // after writing OAM directly rather than through writeOAM.
+    uint8_t spriteBuckets[261][8]{};    // OAM index of the first 8 sprites on the line
+    uint8_t spriteBucketCount[261]{};   // Sprites on the line, including those past 8
+    uint8_t spriteBucketHeight = 0;
+    bool spriteBucketsDirty = true;
+    void writeOAM(uint8_t addr, uint8_t data);
+    void buildSpriteBuckets();
+    void evaluateSprites();         // Dot 257: picks the next line's sprites from its bucket
 
     uint8_t* OAMDATA = reinterpret_cast<uint8_t *>(OAM);
     uint8_t OAMDMA = 0x00;          // Sprite DMA
@@ -106,8 +121,25 @@ public:
     std::array<uint8_t, 4096 * 4> patternTables; // two pattern tables of 256 tiles each (4096 / 16)
     std::array<uint8_t, 4096 * 16> patternTablesDecoded; // two pattern tables of 256 tiles each (4096 / 16) with combined bits
 
+    // Decoded tile cache: each 8 pixel row of the 512 tiles as bit planes and as one byte per
+    // pixel (0-3, leftmost in the low byte), normal and flipped horizontally. A tile is
+    // decoded again on first use after a pattern table write marks it dirty. Call
+    // invalidateTiles when the pattern tables change all at once, e.g. a CHR bank switch.
+    struct TileRow {
+        uint8_t lo, hi;
+        uint8_t flippedLo, flippedHi;
+        uint64_t pixels;
+        uint64_t flippedPixels;
+    };
+    std::array<TileRow, 512 * 8> tileRows{};
+    std::array<bool, 512> tileDirty = [] { std::array<bool, 512> all{}; all.fill(true); return all; }();
+    // addr is the row's low plane, 0x0000-0x1FFF
+    const TileRow& tileRow(uint16_t addr);
+    void invalidateTiles();
+    static uint64_t decodeRow(uint8_t lo, uint8_t hi);
+
     // Palette
-    uint8_t paletteMemory[32];
+    uint8_t paletteMemory[32]{};
 
     // Data buffer
     uint8_t dataBuffer = 0x00;
@@ -134,9 +166,40 @@ public:
     // method to get a tile, returned as an 8-byte array of pixel info (0-3)
     void getTile(uint8_t tileIndex, uint8_t* tileData, bool table1);
 
-    void setPixel(uint8_t x, uint8_t y, uint32_t color);
+    void setPixel(uint8_t x, uint8_t y, uint16_t pixel);
 
     void clock();
+    // Draws dots 0-255 of a visible line at once instead of dot by dot, see catchUp. Turn off
+    // (or build with PPU_RENDERER=dot) to run every dot through clock(), the output is the same.
+#ifdef PPU_DOT_RENDERER
+    bool scanlineRenderer = false;
+#else
+    bool scanlineRenderer = true;
+#endif
+    void renderScanline();
+    void blankScanline();
+
+    // Timing only frames keep everything the CPU can see (vblank and NMI timing, sprite zero
+    // hit, sprite overflow, PPUDATA) but skip palette lookups and framebuffer writes, for
+    // frame skipping. Takes effect from the next frame, nothing is published so frames.latest()
+    // keeps the last frame drawn.
+    bool timingOnly = false;
+    bool frameTimingOnly = false;   // The current frame's setting
+
+    // Deferred rendering: with renderThreads > 0 drawn frames run timing only while the
+    // PPU records what it would need to draw them, and the visible lines are drawn on that
+    // many threads (counting the one running the PPU) when the frame ends, see
+    // DeferredRenderer. Takes effect from the next frame, the pixels are the same.
+    unsigned renderThreads = 0;
+    bool frameDeferred = false;     // The current frame's setting
+    std::unique_ptr<DeferredRenderer> deferredRenderer;
+    bool recording() const {
+        return frameDeferred && scanline >= 0 && scanline < 240;
+    }
+    // Runs the dots the PPU is behind, up to (not including) master clock tick masterCycle.
+    // The bus runs the CPU ahead and only catches the PPU up when it has to, see Bus::syncPpu.
+    void catchUp(uint32_t masterCycle);
+    uint32_t clockCounter = 0;  // Master clock ticks (dots) run, may lag Bus::clockCounter
 
     int16_t cycle = 0;
     int16_t scanline = 0;
@@ -144,16 +207,43 @@ public:
     bool complete_frame = false;
     bool nmi = false;
 
-    uint8_t framebuffer[256 * 240]{};  // 8-bit color indices
-    uint32_t rgbFramebuffer[256 * 240]{}; // 32-bit color for SDL
-    uint32_t nextFrame[256 * 240]{};
+    // Pixels are the 6-bit color index with the emphasis bits above it (PPUMASK bits 5-7 as
+    // bits 6-8), an index into EMPHASIS_PALETTES. Turning them into RGBA is left to whoever
+    // shows the frame, see convertPixels. The PPU draws into the back frame and publishes it
+    // when the frame is done, the screen reads frames.latest(). framebuffer follows the back
+    // frame.
+    TripleBuffer frames;
+    uint16_t* framebuffer = frames.back();
 
     unsigned getColor(int);
 
+    // RGBA of every pixel value: the 64 colors for each combination of the emphasis bits
+    static const std::array<uint32_t, 512> EMPHASIS_PALETTES;
+    // Pixel values of the 32 palette entries with the current grayscale and emphasis bits.
+    // Palette writes and mask writes mark it dirty, it's rebuilt on the next pixel.
+    uint16_t paletteColors[32]{};
+    bool paletteDirty = true;
+    void updatePaletteColors();
+    uint16_t paletteColor(uint8_t entry) {
+        if (paletteDirty) {
+            updatePaletteColors();
+        }
+        return paletteColors[entry];
+    }
+
     void printNameTable();
 
-    // Name tables
-    std::array<uint8_t, 2048> nameTables;
+    // Name tables, the upper 2 KB is only used by four-screen cartridges
+    std::array<uint8_t, 4096> nameTables{};
+
+    // The 1 KB of nameTables each of $2000, $2400, $2800 and $2C00 (and their mirrors at
+    // $3000-$3EFF) maps to, set by setMirroring
+    uint8_t* nameTablePages[4] = {&nameTables[0x0000], &nameTables[0x0000], &nameTables[0x0400], &nameTables[0x0400]};
+    NESROM::Mirroring mirroring = NESROM::HORIZONTAL;
+    void setMirroring(NESROM::Mirroring mirroring);
+    uint8_t& nameTableByte(uint16_t addr) {
+        return nameTablePages[(addr >> 10) & 0x03][addr & 0x03FF];
+    }
 
     std::map<uint8_t, uint16_t> nameTableBaseAddresses = {
         {0b00000000, 0x23C0},
@@ -176,12 +266,20 @@ public:
     uint8_t arr[16] = {0};
 
     // Foreground
-    uint8_t sprite_shifter_pattern_lo[8];
-    uint8_t sprite_shifter_pattern_hi[8];
+    uint8_t sprite_shifter_pattern_lo[8]{};
+    uint8_t sprite_shifter_pattern_hi[8]{};
 
     bool bSpriteZeroHitPossible = false;
     bool bSpriteZeroBeingRendered = false;
 
+    void incrementScrollX();
+    void loadShiftRegisters();
+    void fetchTileId();
+    void fetchTileAttribute();
+    const TileRow& backgroundTileRow();
+    void fetchTileLsb();
+    void fetchTileMsb();
+
     // Given an address, determines mirroring scheme and returns modified address
     uint16_t getMirroredNameTableAddress(uint16_t address);
 
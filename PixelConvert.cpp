@@ -0,0 +1,33 @@
+#include "PixelConvert.h"
+#include "CpuFeatures.h"
+
+void convertPixelsScalar(const uint16_t* pixels, uint32_t* rgba, int count, const uint32_t* palette) {
+    for (int i = 0; i < count; i++) {
+        rgba[i] = palette[pixels[i] & PIXEL_MASK];
+    }
+}
+
+#ifdef CPUFEATURES_X86
+__attribute__((target("avx2")))
+static void convertPixelsAvx2(const uint16_t* pixels, uint32_t* rgba, int count, const uint32_t* palette) {
+    const __m256i mask = _mm256_set1_epi32(PIXEL_MASK);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+        __m256i index = _mm256_and_si256(_mm256_cvtepu16_epi32(packed), mask);
+        __m256i colors = _mm256_i32gather_epi32(reinterpret_cast<const int*>(palette), index, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + i), colors);
+    }
+    convertPixelsScalar(pixels + i, rgba + i, count - i, palette);
+}
+#endif
+
+void convertPixels(const uint16_t* pixels, uint32_t* rgba, int count, const uint32_t* palette) {
+#ifdef CPUFEATURES_X86
+    if (cpuHasAvx2()) {
+        convertPixelsAvx2(pixels, rgba, count, palette);
+        return;
+    }
+#endif
+    convertPixelsScalar(pixels, rgba, count, palette);
+}
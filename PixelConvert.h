@@ -0,0 +1,16 @@
+#ifndef PIXELCONVERT_H
+#define PIXELCONVERT_H
+
+#include <cstdint>
+
+// Converts PPU pixel values (color index | emphasis << 6, see PPU::framebuffer) to RGBA by
+// looking each one up in a 512 entry palette, 8 pixels at a time with AVX2 gathers when
+// the CPU running us has them. Only the low 9 bits of a pixel are used.
+void convertPixels(const uint16_t* pixels, uint32_t* rgba, int count, const uint32_t* palette);
+
+// Same result one pixel at a time, the fallback and the reference for tests
+void convertPixelsScalar(const uint16_t* pixels, uint32_t* rgba, int count, const uint32_t* palette);
+
+constexpr uint16_t PIXEL_MASK = 0x01FF;
+
+#endif // PIXELCONVERT_H
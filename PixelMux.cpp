@@ -0,0 +1,52 @@
+#include "PixelMux.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+uint16_t muxPixelsScalar(const uint8_t* bg, const uint8_t* fg, uint8_t* entries) {
+    uint16_t zeroHits = 0;
+    for (int i = 0; i < 16; i++) {
+        bool bgOpaque = (bg[i] & 0x03) != 0;
+        bool fgOpaque = (fg[i] & 0x03) != 0;
+        if (fgOpaque && (!bgOpaque || (fg[i] & SPRITE_FRONT))) {
+            entries[i] = fg[i] & SPRITE_ENTRY;
+        }
+        else {
+            entries[i] = bgOpaque ? bg[i] : 0x00;
+        }
+        if (bgOpaque && fgOpaque && (fg[i] & SPRITE_ZERO)) {
+            zeroHits |= 1 << i;
+        }
+    }
+    return zeroHits;
+}
+
+#if defined(__SSE2__)
+uint16_t muxPixels(const uint8_t* bg, const uint8_t* fg, uint8_t* entries) {
+    const __m128i pixelBits = _mm_set1_epi8(0x03);
+    const __m128i none = _mm_setzero_si128();
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bg));
+    __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fg));
+
+    // All ones where the pixel is transparent / the sprite is in front / sprite zero
+    __m128i bgClear = _mm_cmpeq_epi8(_mm_and_si128(b, pixelBits), none);
+    __m128i fgClear = _mm_cmpeq_epi8(_mm_and_si128(f, pixelBits), none);
+    __m128i front = _mm_cmpeq_epi8(_mm_and_si128(f, _mm_set1_epi8(SPRITE_FRONT)), _mm_set1_epi8(SPRITE_FRONT));
+    __m128i zero = _mm_cmpeq_epi8(_mm_and_si128(f, _mm_set1_epi8(SPRITE_ZERO)), _mm_set1_epi8(SPRITE_ZERO));
+
+    // The sprite shows where it's opaque and the background is transparent or behind it
+    __m128i useFg = _mm_andnot_si128(fgClear, _mm_or_si128(bgClear, front));
+    __m128i fgEntry = _mm_and_si128(f, _mm_set1_epi8(SPRITE_ENTRY));
+    __m128i bgEntry = _mm_andnot_si128(bgClear, b);
+    __m128i result = _mm_or_si128(_mm_and_si128(useFg, fgEntry), _mm_andnot_si128(useFg, bgEntry));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(entries), result);
+
+    __m128i hits = _mm_andnot_si128(_mm_or_si128(bgClear, fgClear), zero);
+    return static_cast<uint16_t>(_mm_movemask_epi8(hits));
+}
+#else
+uint16_t muxPixels(const uint8_t* bg, const uint8_t* fg, uint8_t* entries) {
+    return muxPixelsScalar(bg, fg, entries);
+}
+#endif
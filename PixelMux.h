@@ -0,0 +1,26 @@
+#ifndef PIXELMUX_H
+#define PIXELMUX_H
+
+#include <cstdint>
+
+// Background/sprite priority multiplexer, 16 pixels at a time (SSE2 where available).
+//
+// bg holds background palette entries, (palette << 2) | pixel with pixel 0 transparent.
+// fg is the sprite line buffer: palette entry in bits 0-4 (pixel in bits 0-1, 0 when no
+// sprite is opaque there), bit 5 set when the sprite is in front of the background and
+// bit 6 when it's sprite zero.
+//
+// Writes the palette entry (0-31) that shows for each pixel, backdrop 0 when both are
+// transparent, and returns a mask of the pixels where sprite zero overlaps an opaque
+// background pixel (bit i for pixel i).
+uint16_t muxPixels(const uint8_t* bg, const uint8_t* fg, uint8_t* entries);
+
+// Same result one pixel at a time, the fallback and the reference for tests
+uint16_t muxPixelsScalar(const uint8_t* bg, const uint8_t* fg, uint8_t* entries);
+
+// Sprite line buffer bits
+constexpr uint8_t SPRITE_ENTRY = 0x1F;
+constexpr uint8_t SPRITE_FRONT = 0x20;
+constexpr uint8_t SPRITE_ZERO = 0x40;
+
+#endif // PIXELMUX_H
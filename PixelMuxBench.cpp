@@ -0,0 +1,59 @@
+// Microbenchmark for the background/sprite multiplexer: muxPixels against the one pixel at
+// a time fallback over a few frames of made up line buffers.
+//
+// make bench && ./pixelmux_bench [frames]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "PixelMux.h"
+
+constexpr int LINE_PIXELS = 256;
+constexpr int FRAME_LINES = 240;
+
+template <typename Mux>
+static double run(Mux mux, const std::vector<uint8_t>& bg, const std::vector<uint8_t>& fg,
+                  std::vector<uint8_t>& entries, int frames, uint32_t& hits) {
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        for (size_t dot = 0; dot < bg.size(); dot += 16) {
+            hits += mux(&bg[dot], &fg[dot], &entries[dot]) != 0;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 2000;
+
+    // Background everywhere, sprites over roughly a quarter of the pixels
+    std::vector<uint8_t> bg(LINE_PIXELS * FRAME_LINES);
+    std::vector<uint8_t> fg(LINE_PIXELS * FRAME_LINES);
+    std::srand(1);
+    for (size_t i = 0; i < bg.size(); i++) {
+        bg[i] = std::rand() & 0x0F;
+        fg[i] = (std::rand() & 3) == 0 ? 0x10 | (std::rand() & 0x6F) : 0x00;
+    }
+
+    std::vector<uint8_t> simd(bg.size());
+    std::vector<uint8_t> scalar(bg.size());
+    uint32_t simdHits = 0;
+    uint32_t scalarHits = 0;
+    double simdTime = run(muxPixels, bg, fg, simd, frames, simdHits);
+    double scalarTime = run(muxPixelsScalar, bg, fg, scalar, frames, scalarHits);
+    if (simd != scalar || simdHits != scalarHits) {
+        std::printf("muxPixels and muxPixelsScalar disagree\n");
+        return 1;
+    }
+
+    double pixels = static_cast<double>(bg.size()) * frames;
+    std::printf("%d frames of %d pixels\n", frames, LINE_PIXELS * FRAME_LINES);
+    std::printf("muxPixels       %8.3f ms/frame %8.2f Mpixel/s\n", simdTime * 1000 / frames, pixels / simdTime / 1e6);
+    std::printf("muxPixelsScalar %8.3f ms/frame %8.2f Mpixel/s\n", scalarTime * 1000 / frames, pixels / scalarTime / 1e6);
+    std::printf("speedup %.2fx\n", scalarTime / simdTime);
+    return 0;
+}
@@ -55,6 +55,12 @@ bool NESROM::load(const std::string& filepath) {
         return false;
     }
     ROMheader = header;
+    if (header.flags6 & 0x08) {
+        mirroring = FOUR_SCREEN;
+    }
+    else {
+        mirroring = (header.flags6 & 0x01) ? VERTICAL : HORIZONTAL;
+    }
 
 	detect_mapper(header, file);
 
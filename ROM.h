@@ -29,6 +29,17 @@ public:
     NESHeader ROMheader;
     bool mirrored = false;    // Flag for NROM-128 mirroring
 
+    // How the PPU's four nametables map onto VRAM, see PPU::setMirroring. Taken from the
+    // header, mappers that switch it at runtime pass the new one to the PPU.
+    enum Mirroring : uint8_t {
+        HORIZONTAL,         // $2000 = $2400, $2800 = $2C00
+        VERTICAL,           // $2000 = $2800, $2400 = $2C00
+        SINGLE_SCREEN_LOW,  // All four are the first 1 KB
+        SINGLE_SCREEN_HIGH, // All four are the second 1 KB
+        FOUR_SCREEN         // Four separate tables, the cartridge adds 2 KB of VRAM
+    };
+    Mirroring mirroring = HORIZONTAL;
+
     // Function to detect and initialize the mapper based on header and file data
     void detect_mapper(const NESHeader& header, std::ifstream& file);
 
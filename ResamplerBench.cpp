@@ -0,0 +1,66 @@
+// Microbenchmark for the APU's resampler: BlipBuffer::addDelta against the one tap at a time
+// fallback, over a few seconds of made up output changes as busy as the noise channel at
+// its fastest, resampled to 44.1 kHz a frame at a time.
+//
+// make bench && ./resampler_bench [frames]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "BlipBuffer.h"
+
+constexpr double CLOCK_RATE = 1789773.0 * 3;
+constexpr int SAMPLE_RATE = 44100;
+constexpr uint32_t FRAME_TICKS = 89342;
+
+struct Delta {
+    uint32_t time;
+    float delta;
+};
+
+template <typename Add>
+static double run(Add add, const std::vector<Delta>& deltas, int frames, std::vector<float>& samples) {
+    BlipBuffer blip(CLOCK_RATE, SAMPLE_RATE, SAMPLE_RATE / 4);
+    std::vector<float> frame(SAMPLE_RATE / 4);
+    samples.clear();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        for (const Delta& d : deltas) {
+            add(blip, d.time, d.delta);
+        }
+        blip.endFrame(FRAME_TICKS);
+        int count = blip.readSamples(frame.data(), static_cast<int>(frame.size()));
+        samples.insert(samples.end(), frame.begin(), frame.begin() + count);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 600;
+
+    // A change every 12 to 24 ticks, the same every frame
+    std::vector<Delta> deltas;
+    std::srand(1);
+    for (uint32_t time = 0; time < FRAME_TICKS; time += 12 + std::rand() % 13) {
+        deltas.push_back({time, (std::rand() % 31 - 15) / 64.0f});
+    }
+
+    std::vector<float> simd;
+    std::vector<float> scalar;
+    double simdTime = run([](BlipBuffer& b, uint32_t t, float d) { b.addDelta(t, d); }, deltas, frames, simd);
+    double scalarTime = run([](BlipBuffer& b, uint32_t t, float d) { b.addDeltaScalar(t, d); }, deltas, frames, scalar);
+    if (simd != scalar) {
+        std::printf("addDelta and addDeltaScalar disagree\n");
+        return 1;
+    }
+
+    double total = static_cast<double>(deltas.size()) * frames;
+    std::printf("%d frames of %zu deltas, %zu samples out\n", frames, deltas.size(), simd.size());
+    std::printf("addDelta       %8.3f ms/frame %8.2f Mdelta/s\n", simdTime * 1000 / frames, total / simdTime / 1e6);
+    std::printf("addDeltaScalar %8.3f ms/frame %8.2f Mdelta/s\n", scalarTime * 1000 / frames, total / scalarTime / 1e6);
+    std::printf("speedup %.2fx\n", scalarTime / simdTime);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+
+void Scheduler::schedule(Event event, uint32_t tick) {
+    Pending& pending = pendingTick[event];
+    pending.has = true;
+    pending.generation++;
+    heap.push_back({tick, event, pending.generation});
+    std::push_heap(heap.begin(), heap.end(), later);
+}
+
+void Scheduler::cancel(Event event) {
+    // The heap entry stays behind and is dropped once it reaches the top
+    pendingTick[event].has = false;
+    pendingTick[event].generation++;
+}
+
+void Scheduler::clear() {
+    heap.clear();
+    for (Pending& pending : pendingTick) {
+        pending.has = false;
+        pending.generation++;
+    }
+}
+
+void Scheduler::dropStale() {
+    while (!heap.empty()) {
+        const Entry& top = heap.front();
+        const Pending& pending = pendingTick[top.event];
+        if (pending.has && pending.generation == top.generation) {
+            return;
+        }
+        std::pop_heap(heap.begin(), heap.end(), later);
+        heap.pop_back();
+    }
+}
+
+bool Scheduler::empty() {
+    dropStale();
+    return heap.empty();
+}
+
+uint32_t Scheduler::nextTick() {
+    dropStale();
+    return heap.front().tick;
+}
+
+bool Scheduler::popDue(uint32_t tick, Event& event) {
+    dropStale();
+    if (heap.empty() || heap.front().tick != tick) {
+        return false;
+    }
+    event = heap.front().event;
+    pendingTick[event].has = false;
+    std::pop_heap(heap.begin(), heap.end(), later);
+    heap.pop_back();
+    return true;
+}
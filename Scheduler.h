@@ -0,0 +1,55 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+#include <vector>
+
+// Future events on the master clock (Bus::clockCounter), kept in a min-heap so the bus can
+// run straight from one to the next instead of polling every device on every tick.
+//
+// Each kind of event is pending at most once, scheduling it again moves it. Ticks are
+// compared relative to each other, so they may wrap around as long as every pending event
+// is less than 2^31 ticks away.
+class Scheduler {
+public:
+    enum Event : uint8_t {
+        VBLANK,             // PPU reaches scanline 241 dot 1 and may raise an NMI
+        FRAME_SEQUENCER,    // APU frame sequencer clocks envelopes, length counters, sweeps
+        DMA_COMPLETE,       // Last OAM DMA write, the CPU runs again after this tick
+        SPRITE_EVALUATION,  // PPU reads OAM for the next scanline (only needed during DMA)
+        DMC_FETCH,          // DMC reads a sample byte, stalling the CPU, and may raise its IRQ
+        EVENT_COUNT
+    };
+
+    void schedule(Event event, uint32_t tick);
+    void cancel(Event event);
+    void clear();
+
+    bool pending(Event event) const { return pendingTick[event].has; }
+    bool empty();
+    uint32_t nextTick();                // Earliest pending event, the heap must not be empty
+    bool popDue(uint32_t tick, Event& event);   // Next event scheduled at tick, if any
+
+private:
+    struct Entry {
+        uint32_t tick;
+        Event event;
+        uint32_t generation;
+    };
+
+    struct Pending {
+        bool has = false;
+        uint32_t generation = 0;
+    };
+
+    std::vector<Entry> heap;
+    Pending pendingTick[EVENT_COUNT];
+
+    static bool later(const Entry& a, const Entry& b) {
+        return static_cast<int32_t>(a.tick - b.tick) > 0;
+    }
+    // Drops entries that were moved or cancelled since they were pushed
+    void dropStale();
+};
+
+#endif // SCHEDULER_H
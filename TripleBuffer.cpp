@@ -0,0 +1,14 @@
+#include "TripleBuffer.h"
+
+void TripleBuffer::publish() {
+    // Release makes the frame's pixels visible to the consumer that picks it up, acquire
+    // makes sure the consumer is done with the frame we get back before we draw over it
+    backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+}
+
+const uint16_t* TripleBuffer::latest() {
+    if (middle.load(std::memory_order_relaxed) & FRESH) {
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+    }
+    return frames[frontIndex];
+}
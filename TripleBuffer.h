@@ -0,0 +1,35 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Hands finished frames of PPU pixel values to the screen without copying or locking. Of the three
+// frames one is being drawn (back), one is being shown (front) and the third is the middle,
+// which publish and latest swap with the back and front respectively. A single producer
+// and a single consumer may run on different threads, the consumer always gets the newest
+// complete frame and never one still being drawn.
+class TripleBuffer {
+public:
+    static constexpr int WIDTH = 256;
+    static constexpr int HEIGHT = 240;
+
+    // Producer: the frame to draw into, changes on every publish
+    uint16_t* back() { return frames[backIndex]; }
+    // Producer: makes the back frame the newest complete frame
+    void publish();
+
+    // Consumer: the newest complete frame, valid until the next call
+    const uint16_t* latest();
+
+private:
+    static constexpr uint8_t INDEX = 0x03;
+    static constexpr uint8_t FRESH = 0x04;  // Set in middle when it holds a frame not yet shown
+
+    uint16_t frames[3][WIDTH * HEIGHT]{};
+    uint8_t backIndex = 0;                  // Only touched by the producer
+    uint8_t frontIndex = 1;                 // Only touched by the consumer
+    std::atomic<uint8_t> middle{2};
+};
+
+#endif // TRIPLEBUFFER_H
@@ -187,7 +187,7 @@ int main(int, char**)
           //ImGui::Begin("NES Emulator", nullptr, ImGuiWindowFlags_NoResize;		// don't allow resizing?
           ImVec2 widgetSize = ImGui::GetContentRegionAvail();
 
-          uint32_t* framebuffer = nes.getFramebuffer();
+          const uint32_t* framebuffer = nes.getFramebuffer();
 
 
           // Set the width and height of the NES screen
@@ -304,9 +304,10 @@ int main(int, char**)
               ImGui::Text("Y:    [%02x]     Select: [%01x]", nes.cpu.Y, nes.bus.controller1.select);
               ImGui::Text("PC: [%04x]     Start:  [%01x]", nes.cpu.PC, nes.bus.controller1.start);
               ImGui::Text("S:  [%04x]     Up:     [%01x]", nes.cpu.S, nes.bus.controller1.up);
-              ImGui::Text("P:  [%04x]     Down:   [%01x]", nes.cpu.P, nes.bus.controller1.down);
+              ImGui::Text("P:  [%04x]     Down:   [%01x]", nes.cpu.status(), nes.bus.controller1.down);
               ImGui::Text("               Left:   [%01x]", nes.bus.controller1.left);
               ImGui::Text("               Right:  [%01x]", nes.bus.controller1.right);
+              ImGui::Text("Idle cycles skipped: %llu", (unsigned long long)nes.idleCyclesLastFrame);
 
               ImGui::End();
           }
@@ -317,7 +318,7 @@ int main(int, char**)
                     nes.cycle();
 
                     // Get the NES framebuffer (assuming it returns 32-bit RGBA data)
-                    uint32_t* pixels = nes.getFramebuffer();
+                    const uint32_t* pixels = nes.getFramebuffer();
                 }
 
         // Rendering
@@ -40,9 +40,31 @@ int main(int argc, char* argv[]) {
 	tests.test_CPX();
 	tests.test_CPY();
 	tests.test_CLD_SED_CLV();
+	tests.test_opcode_table();
+	tests.test_predecode(testPath);
+	tests.test_dynarec(testPath);
+	tests.test_idle_skip(testPath);
+	tests.test_scheduler();
+	tests.test_run_until(testPath);
+	tests.test_dmc(testPath);
+	tests.test_memory_map(testPath);
+	tests.test_scanline_renderer(testPath);
+	tests.test_timing_only(testPath);
+	tests.test_deferred_renderer(testPath);
+	tests.test_triple_buffer();
 	tests.test_NES(testPath);
 	tests.test_Bus();
 	tests.test_PPU_registers();
+	tests.test_palette();
+	tests.test_nametable_mirroring(testPath);
+	tests.test_tile_cache();
+	tests.test_sprite_buckets();
+	tests.test_pixel_mux();
+	tests.test_pixel_convert();
+	tests.test_apu_synthesis();
+	tests.test_audio_ring();
+	tests.test_resampler(testPath);
+	tests.test_apu_mixer();
 	tests.test_pattern_tables(testPath);
 	tests.test_Pulse1();
 
@@ -11,7 +11,7 @@ void Tests::test_cpu() {
 	assert(cpu.X == 0x00);
 	assert(cpu.Y == 0x00);
 	assert(cpu.S == 0xFD);
-	assert(cpu.P == 0x00);
+	assert(cpu.status() == 0x00);
 
 	// Check write
 	cpu.writeBus(0x10, 0xAB);
@@ -229,7 +229,7 @@ void Tests::test_reset() {
 	cpu.printRegisters();
 
 	//Check if values match reset
-	assert(cpu.P == 0x24);
+	assert(cpu.status() == 0x24);
 	assert(cpu.S == 0xFD);
 	assert(cpu.PC == 0xC2A9);
 
@@ -320,7 +320,7 @@ void Tests::test_jmp() {
 	cpu.RTI(test_memory);
 
 	assert(cpu.PC == 0x1975);
-	assert(cpu.P == 0x67);
+	assert(cpu.status() == 0x67);
 
 	// Test Indirect Jump
 
@@ -354,7 +354,7 @@ void Tests::test_stack_instructions() {
 	cpu.PHP(test_memory);
 	cpu.PLP(test_memory);
 
-	assert(cpu.P == 0x24);
+	assert(cpu.status() == 0x24);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------
@@ -630,6 +630,639 @@ void Tests::test_CLD_SED_CLV() {
 
     std::cout << "---------------------------\nCLD_SED_CLV Instruction tests passed!\n";
 }
+//----------------------------------------------------------------------------------------------------------------------------
+void Tests::test_opcode_table() {
+	NES nes;
+	CPU& cpu = *nes.bus.cpu;
+
+	// Metadata
+	assert(OPCODE_TABLE[0xBD].op == Op::LDA);
+	assert(OPCODE_TABLE[0xBD].mode == AddrMode::AbsoluteX);
+	assert(OPCODE_TABLE[0xBD].bytes == 3);
+	assert(OPCODE_TABLE[0xBD].cycles == 4);
+	assert(OPCODE_TABLE[0xBD].pageCrossPenalty == 1);
+	assert(OPCODE_TABLE[0x9D].access == Access::Write);
+	assert(OPCODE_TABLE[0x0A].access == Access::None);
+	assert(OPCODE_TABLE[0x02].valid == false);
+
+	// Every valid opcode has a legacy table entry and nothing else does
+	for (int i = 0; i < 256; i++) {
+		assert(OPCODE_TABLE[i].valid == (CPU::instructionTable[i].operation != nullptr));
+	}
+
+	// Table cycles match what the interpreter charges (no page cross)
+	cpu.writeBus(0x00, 0xAD); // LDA $0200
+	cpu.writeBus(0x01, 0x00);
+	cpu.writeBus(0x02, 0x02);
+	cpu.PC = 0x0000;
+	cpu.cycles = 0;
+	cpu.cycleExecute();
+	assert(cpu.cycles + 1 == OPCODE_TABLE[0xAD].cycles);
+
+	// Disassembly
+	assert(cpu.disassemble(0x0000) == "LDA $0200");
+	cpu.writeBus(0x03, 0xB1); // LDA ($23),Y
+	cpu.writeBus(0x04, 0x23);
+	assert(cpu.disassemble(0x0003) == "LDA ($23),Y");
+	cpu.writeBus(0x05, 0xD0); // BNE -2
+	cpu.writeBus(0x06, 0xFE);
+	assert(cpu.disassemble(0x0005) == "BNE $0005");
+
+	std::cout << "---------------------------\nOpcode table tests passed!\n";
+}
+
+// Two machines that must behave the same: CPU registers and RAM match
+static void assertSameCpu(NES& a, NES& b) {
+	assert(a.cpu.PC == b.cpu.PC);
+	assert(a.cpu.A == b.cpu.A && a.cpu.X == b.cpu.X && a.cpu.Y == b.cpu.Y);
+	assert(a.cpu.S == b.cpu.S && a.cpu.status() == b.cpu.status());
+	assert(a.cpu.cycles == b.cpu.cycles);
+	assert(a.bus.cpuRam == b.bus.cpuRam);
+}
+
+// Clocks both a frame at a time, with Bus::syncClock at each frame's end, and after every
+// frame checks them with assertSameCpu and then check, if given
+static void runFramesInLockstep(NES& a, NES& b, int frames, void (*check)(NES&, NES&) = nullptr) {
+	for (int frame = 0; frame < frames; frame++) {
+		a.bus.syncClock = a.bus.clockCounter + 89342;
+		b.bus.syncClock = b.bus.clockCounter + 89342;
+		for (int i = 0; i < 89342; i++) {
+			a.bus.clock();
+			b.bus.clock();
+		}
+		assertSameCpu(a, b);
+		if (check) {
+			check(a, b);
+		}
+	}
+}
+
+void Tests::test_predecode(std::string path) {
+	NES nes;
+	CPU& cpu = *nes.bus.cpu;
+
+	// Code in RAM is cached and dropped when it gets written
+	cpu.writeBus(0x0300, 0xA9); // LDA #$11
+	cpu.writeBus(0x0301, 0x11);
+	cpu.PC = 0x0300;
+	cpu.cycles = 0;
+	cpu.cycleExecute();
+	assert(cpu.A == 0x11);
+	assert(cpu.decodeCache[0x0300].handler != nullptr);
+
+	cpu.writeBus(0x0B01, 0x22); // Operand through a RAM mirror
+	assert(cpu.decodeCache[0x0300].handler == nullptr);
+	cpu.PC = 0x0300;
+	cpu.cycles = 0;
+	cpu.cycleExecute();
+	assert(cpu.A == 0x22);
+
+	// Predecoded and plain interpreter stay in lockstep on a real ROM
+	NES cached;
+	NES plain;
+	cached.load_rom(path.c_str());
+	plain.load_rom(path.c_str());
+	cached.initNES();
+	plain.initNES();
+	plain.cpu.predecode = false;
+	runFramesInLockstep(cached, plain, 10);
+
+	std::cout << "---------------------------\nPredecode tests passed!\n";
+}
+
+void Tests::test_dynarec(std::string path) {
+	if (!Dynarec::supported()) {
+		std::cout << "---------------------------\nDynarec not supported on this host, skipped\n";
+		return;
+	}
+
+	// Compiled blocks checked against the interpreter as they run, and the whole machine
+	// against one that never uses them
+	NES compiled;
+	NES plain;
+	compiled.load_rom(path.c_str());
+	plain.load_rom(path.c_str());
+	compiled.initNES();
+	plain.initNES();
+	compiled.cpu.enableDynarec(true, true);
+	runFramesInLockstep(compiled, plain, 30);
+	assert(compiled.cpu.dynarec->blocksRun > 0);
+	assert(compiled.cpu.dynarec->mismatches == 0);
+
+	std::cout << "---------------------------\nDynarec tests passed!\n";
+}
+
+void Tests::test_idle_skip(std::string path) {
+	// Skipping spin loops must not be visible at frame boundaries
+	NES skipping;
+	NES plain;
+	skipping.load_rom(path.c_str());
+	plain.load_rom(path.c_str());
+	skipping.initNES();
+	plain.initNES();
+	plain.cpu.idleSkip = false;
+	runFramesInLockstep(skipping, plain, 30, [](NES& a, NES& b) {
+		assert(a.bus.ppu.status.reg == b.bus.ppu.status.reg);
+	});
+	assert(skipping.cpu.idleCyclesSkipped > 0);
+	assert(plain.cpu.idleCyclesSkipped == 0);
+
+	// Looking at a loop head in the register range must not read the register
+	plain.bus.ppu.status.vblank = 1;
+	plain.bus.ppu.w = 1;
+	assert(!plain.cpu.analyzeIdleLoop(0x2002));
+	assert(plain.bus.ppu.status.vblank == 1 && plain.bus.ppu.w == 1);
+
+	std::cout << "---------------------------\nIdle loop tests passed!\n";
+}
+
+void Tests::test_run_until(std::string path) {
+	// Running to a timestamp matches clocking one tick at a time, also when the target
+	// falls in the middle of an instruction
+	NES batched;
+	NES stepped;
+	batched.load_rom(path.c_str());
+	stepped.load_rom(path.c_str());
+	batched.initNES();
+	stepped.initNES();
+	for (int chunk = 0; chunk < 300; chunk++) {
+		uint32_t ticks = 7919 + chunk * 13;
+		batched.bus.runUntil(batched.bus.clockCounter + ticks);
+		for (uint32_t i = 0; i < ticks; i++) {
+			stepped.bus.clock();
+		}
+		assert(batched.bus.clockCounter == stepped.bus.clockCounter);
+		assert(batched.bus.cpuClockCounter == stepped.bus.cpuClockCounter);
+		assert(batched.bus.ppu.clockCounter == batched.bus.clockCounter);
+		assert(batched.bus.apu->clockCounter == batched.bus.clockCounter);
+		assertSameCpu(batched, stepped);
+		assert(batched.bus.ppu.scanline == stepped.bus.ppu.scanline && batched.bus.ppu.cycle == stepped.bus.ppu.cycle);
+		assert(batched.bus.ppu.status.reg == stepped.bus.ppu.status.reg);
+		assert(std::memcmp(batched.bus.ppu.OAMDATA, stepped.bus.ppu.OAMDATA, 256) == 0);
+
+		// OAM DMA from RAM (run between events) and from PPU registers (tick by tick),
+		// started at different points of the frame. Stopping part way through, the
+		// scanlines the PPU evaluated so far must have seen the same OAM.
+		if (chunk % 50 == 7 || chunk % 50 == 33) {
+			uint8_t page = chunk % 50 == 7 ? 0x07 : 0x20;
+			for (NES* nes : {&batched, &stepped}) {
+				for (int i = 0; i < 256; i++) {
+					nes->bus.write(0x0700 + i, i * 37 + chunk);
+				}
+				nes->bus.write(0x4014, page);
+			}
+			batched.bus.runUntil(batched.bus.clockCounter + 1000);
+			for (int i = 0; i < 1000; i++) {
+				stepped.bus.clock();
+			}
+			assert(std::memcmp(batched.bus.ppu.OAMDATA, stepped.bus.ppu.OAMDATA, 256) == 0);
+			assert(std::memcmp(batched.bus.ppu.spriteScanline, stepped.bus.ppu.spriteScanline, sizeof(batched.bus.ppu.spriteScanline)) == 0);
+		}
+	}
+
+	// Dot timing worked out while the PPU is behind is where it gets to once caught up
+	uint32_t vblank = batched.bus.nextDotTick(241, 1, batched.bus.clockCounter + 50000);
+	batched.bus.ppu.catchUp(vblank);
+	assert(batched.bus.ppu.scanline == 241 && batched.bus.ppu.cycle == 1);
+
+	std::cout << "---------------------------\nrunUntil tests passed!\n";
+}
+
+void Tests::test_dmc(std::string path) {
+	// Starting a sample fetches its first byte right away, stalling the CPU
+	NES direct;
+	direct.load_rom(path.c_str());
+	direct.initNES();
+	uint32_t before = direct.cpu.cycles;
+	direct.bus.write(0x4013, 0x00);
+	direct.bus.write(0x4015, 0x10);
+	assert(direct.cpu.cycles == before + APU::DMC_STALL_CYCLES);
+	assert(direct.bus.read(0x4015) == 0x00);      // That was its only byte
+
+	// A program looping on a 17 byte sample at the fastest rate, with the IRQ at its end
+	// counted in $10, acknowledged and the sample restarted. The main loop is a JMP to
+	// itself, which the idle loop skip would run past the fetches and the IRQs.
+	const uint8_t program[] = {
+		0xA9, 0x8F, 0x8D, 0x10, 0x40,   // LDA #$8F, STA $4010  IRQ on, rate 54 cycles
+		0xA9, 0x00, 0x8D, 0x12, 0x40,   // LDA #$00, STA $4012  Sample at $C000
+		0xA9, 0x01, 0x8D, 0x13, 0x40,   // LDA #$01, STA $4013  17 bytes
+		0xA9, 0x10, 0x8D, 0x15, 0x40,   // LDA #$10, STA $4015  Start
+		0x58,                           // CLI
+		0x4C, 0x15, 0x02,               // JMP $0215
+	};
+	const uint8_t handler[] = {
+		0xE6, 0x10,                     // INC $10
+		0xA9, 0x10, 0x8D, 0x15, 0x40,   // LDA #$10, STA $4015  Acknowledge, restart
+		0x40,                           // RTI
+	};
+	// Events and a tick at a time, a tick at a time without the idle loop skip
+	NES batched;
+	NES stepped;
+	NES plain;
+	for (NES* nes : {&batched, &stepped, &plain}) {
+		nes->load_rom(path.c_str());
+		nes->initNES();
+		for (size_t i = 0; i < sizeof(program); i++) {
+			nes->bus.write(0x0200 + i, program[i]);
+		}
+		for (size_t i = 0; i < sizeof(handler); i++) {
+			nes->bus.write(0x0300 + i, handler[i]);
+		}
+		nes->bus.write(0xFFFE, 0x00);
+		nes->bus.write(0xFFFF, 0x03);
+		nes->cpu.PC = 0x0200;
+		nes->cpu.cycles = 0;
+	}
+	plain.cpu.idleSkip = false;
+
+	uint32_t total = 0;
+	for (int chunk = 0; chunk < 200; chunk++) {
+		uint32_t ticks = 7919 + chunk * 13;
+		total += ticks;
+		batched.bus.syncClock = batched.bus.clockCounter + ticks;
+		stepped.bus.syncClock = stepped.bus.clockCounter + ticks;
+		batched.bus.runUntil(batched.bus.syncClock);
+		for (uint32_t i = 0; i < ticks; i++) {
+			stepped.bus.clock();
+			plain.bus.clock();
+		}
+		for (NES* nes : {&stepped, &plain}) {
+			assert(batched.bus.cpuClockCounter == nes->bus.cpuClockCounter);
+			assertSameCpu(batched, *nes);
+		}
+	}
+	assert(batched.cpu.idleCyclesSkipped > 0);
+
+	// One IRQ per sample: 17 bytes of 8 bits at 54 cycles each, plus the handler
+	uint32_t perSample = 17 * 8 * 54 * 3;
+	assert(std::abs(static_cast<int>(batched.bus.cpuRam[0x10]) - static_cast<int>(total / perSample % 256)) <= 1);
+
+	std::cout << "---------------------------\nDMC tests passed!\n";
+}
+
+void Tests::test_scanline_renderer(std::string path) {
+	// Drawing whole scanlines gives the same frames and PPU state as drawing dot by dot.
+	// Runs stop at uneven points, so some lines are split and drawn dot by dot in both.
+	NES scanlines;
+	NES dots;
+	scanlines.load_rom(path.c_str());
+	dots.load_rom(path.c_str());
+	scanlines.initNES();
+	dots.initNES();
+	dots.bus.ppu.scanlineRenderer = false;
+	for (int chunk = 0; chunk < 400; chunk++) {
+		// From here on glyphs all over the background with sprites on top: every x near
+		// the edges, flips, behind-background priority and a sprite zero to hit
+		if (chunk == 100) {
+			for (NES* nes : {&scanlines, &dots}) {
+				PPU& ppu = nes->bus.ppu;
+				for (int i = 0; i < 2048; i++) {
+					ppu.nameTables[i] = 0x41 + (i * 7) % 26;
+				}
+				for (int i = 0; i < 32; i++) {
+					ppu.paletteMemory[i] = (i * 11) % 64;
+				}
+				for (int i = 0; i < 64; i++) {
+					ppu.OAM[i].y = (i * 29) % 232;
+					ppu.OAM[i].id = 0x41 + i % 26;
+					ppu.OAM[i].attribute = (i * 0x45) & 0xE3;
+					ppu.OAM[i].x = i < 8 ? i : i < 16 ? 240 + i : (i * 53) % 256;
+				}
+				ppu.OAM[0].y = 16;
+				ppu.OAM[0].x = 3;
+				ppu.spriteBucketsDirty = true;
+				nes->bus.write(0x2001, 0x1E);
+			}
+		}
+		// Rendering off for a while, lines drawn at once show the frozen shifters. Moving v
+		// changes the tile the idle fetches load.
+		if (chunk == 250 || chunk == 280) {
+			scanlines.bus.write(0x2001, chunk == 250 ? 0x00 : 0x1E);
+			dots.bus.write(0x2001, chunk == 250 ? 0x00 : 0x1E);
+		}
+		if (chunk > 250 && chunk < 280) {
+			scanlines.bus.ppu.v.vram_register = (chunk * 0x1357) & 0x7FFF;
+			dots.bus.ppu.v.vram_register = (chunk * 0x1357) & 0x7FFF;
+		}
+		// Every fine x scroll
+		if (chunk >= 100) {
+			scanlines.bus.ppu.x = chunk % 8;
+			dots.bus.ppu.x = chunk % 8;
+		}
+		uint32_t ticks = 20011 + chunk * 7;
+		scanlines.bus.runUntil(scanlines.bus.clockCounter + ticks);
+		dots.bus.runUntil(dots.bus.clockCounter + ticks);
+
+		PPU& a = scanlines.bus.ppu;
+		PPU& b = dots.bus.ppu;
+		assert(std::memcmp(a.framebuffer, b.framebuffer, 256 * 240 * sizeof(uint16_t)) == 0);
+		assert(std::memcmp(scanlines.getFramebuffer(), dots.getFramebuffer(), 256 * 240 * sizeof(uint32_t)) == 0);
+		assert(a.scanline == b.scanline && a.cycle == b.cycle && a.status.reg == b.status.reg);
+		assert(a.v.vram_register == b.v.vram_register);
+		assert(a.bg_shifter_tile_lo == b.bg_shifter_tile_lo && a.bg_shifter_tile_hi == b.bg_shifter_tile_hi);
+		assert(a.bg_shifter_attribute_lo == b.bg_shifter_attribute_lo && a.bg_shifter_attribute_hi == b.bg_shifter_attribute_hi);
+		assert(std::memcmp(a.arr, b.arr, sizeof(a.arr)) == 0);
+		assert(a.next_bg_tile_id == b.next_bg_tile_id && a.next_bg_tile_attribute == b.next_bg_tile_attribute);
+		assert(a.next_bg_tile_lsb == b.next_bg_tile_lsb && a.next_bg_tile_msb == b.next_bg_tile_msb);
+		assert(a.numOfSprites == b.numOfSprites);
+		assert(std::memcmp(a.spriteScanline, b.spriteScanline, sizeof(a.spriteScanline)) == 0);
+		assert(std::memcmp(a.sprite_shifter_pattern_lo, b.sprite_shifter_pattern_lo, 8) == 0);
+		assert(std::memcmp(a.sprite_shifter_pattern_hi, b.sprite_shifter_pattern_hi, 8) == 0);
+		assert(a.bSpriteZeroBeingRendered == b.bSpriteZeroBeingRendered);
+		assert(scanlines.bus.cpuRam == dots.bus.cpuRam);
+		assert(scanlines.cpu.PC == dots.cpu.PC);
+	}
+
+	std::cout << "---------------------------\nScanline renderer tests passed!\n";
+}
+
+void Tests::test_timing_only(std::string path) {
+	// Frames without pixels run exactly like drawn ones, sprite zero hits included
+	NES drawn;
+	NES timing;
+	drawn.load_rom(path.c_str());
+	timing.load_rom(path.c_str());
+	drawn.initNES();
+	timing.initNES();
+	timing.bus.ppu.timingOnly = true;
+	timing.bus.ppu.frameTimingOnly = true;
+	for (int chunk = 0; chunk < 120; chunk++) {
+		if (chunk == 30) {
+			for (NES* nes : {&drawn, &timing}) {
+				for (int i = 0; i < 2048; i++) {
+					nes->bus.ppu.nameTables[i] = 0x41 + i % 26;
+				}
+				nes->bus.ppu.OAM[0] = {40, 'N', 0x00, 30};
+				nes->bus.ppu.spriteBucketsDirty = true;
+				nes->bus.write(0x2001, 0x1E);
+			}
+		}
+		uint32_t ticks = 30011 + chunk * 7;
+		drawn.bus.runUntil(drawn.bus.clockCounter + ticks);
+		timing.bus.runUntil(timing.bus.clockCounter + ticks);
+		assert(drawn.bus.ppu.status.reg == timing.bus.ppu.status.reg);
+		assert(drawn.bus.ppu.v.vram_register == timing.bus.ppu.v.vram_register);
+		assert(drawn.bus.ppu.scanline == timing.bus.ppu.scanline && drawn.bus.ppu.cycle == timing.bus.ppu.cycle);
+		assert(drawn.bus.cpuRam == timing.bus.cpuRam);
+		assert(drawn.cpu.PC == timing.cpu.PC && drawn.cpu.cycles == timing.cpu.cycles);
+	}
+	// Nothing drawn
+	uint16_t blank[256]{};
+	assert(std::memcmp(timing.bus.ppu.framebuffer + 200 * 256, blank, sizeof(blank)) == 0);
+	assert(std::memcmp(drawn.bus.ppu.framebuffer + 200 * 256, blank, sizeof(blank)) != 0);
+	// and nothing published
+	assert(std::memcmp(timing.getPixels() + 200 * 256, blank, sizeof(blank)) == 0);
+	assert(std::memcmp(drawn.getPixels() + 200 * 256, blank, sizeof(blank)) != 0);
+
+	// Frame skip 2 draws every third frame
+	NES skipping;
+	skipping.load_rom(path.c_str());
+	skipping.initNES();
+	skipping.frameSkip = 2;
+	bool expected[6] = {false, true, true, false, true, true};
+	for (bool timingOnly : expected) {
+		skipping.cycle();
+		assert(skipping.bus.ppu.timingOnly == timingOnly);
+	}
+
+	std::cout << "---------------------------\nTiming only tests passed!\n";
+}
+
+void Tests::test_deferred_renderer(std::string path) {
+	// Frames drawn afterwards on several threads from the recorded accesses match frames
+	// drawn as they run, with the CPU poking the PPU all over the frame
+	NES deferred;
+	NES direct;
+	deferred.load_rom(path.c_str());
+	direct.load_rom(path.c_str());
+	deferred.initNES();
+	direct.initNES();
+	deferred.bus.ppu.renderThreads = 3;
+	uint32_t seed = 1;
+	auto random = [&seed](uint32_t range) {
+		seed = seed * 1103515245 + 12345;
+		return (seed >> 16) % range;
+	};
+	for (int chunk = 0; chunk < 500; chunk++) {
+		// The same accesses go to both, through the bus like CPU accesses
+		uint32_t stream = seed;
+		for (NES* nes : {&deferred, &direct}) {
+			seed = stream;
+			Bus& bus = nes->bus;
+			if (chunk == 40) {
+				// Glyphs all over the nametables, a palette and sprites, written through
+				// the registers with rendering off
+				bus.write(0x2001, 0x00);
+				bus.write(0x2006, 0x20);
+				bus.write(0x2006, 0x00);
+				for (int i = 0; i < 2048; i++) {
+					bus.write(0x2007, 0x41 + (i * 7) % 26);
+				}
+				bus.write(0x2006, 0x3F);
+				bus.write(0x2006, 0x00);
+				for (int i = 0; i < 32; i++) {
+					bus.write(0x2007, (i * 11) % 64);
+				}
+				bus.write(0x2003, 0x00);
+				for (int i = 0; i < 64; i++) {
+					bus.write(0x2004, (i * 29) % 232);
+					bus.write(0x2004, 0x41 + i % 26);
+					bus.write(0x2004, (i * 0x45) & 0xE3);
+					bus.write(0x2004, i < 8 ? i : (i * 53) % 256);
+				}
+				bus.write(0x2001, 0x1E);
+			}
+			if (chunk >= 40) {
+				switch (random(12)) {
+					case 0:     // Scroll, sometimes with the latch reset in between
+						bus.write(0x2005, random(256));
+						if (random(2)) {
+							bus.read(0x2002);
+						}
+						bus.write(0x2005, random(240));
+						break;
+					case 1:     // Jump v mid-frame
+						bus.write(0x2006, 0x20 + random(16));
+						bus.write(0x2006, random(256));
+						break;
+					case 2:     // Nametables, pattern tables and sprite size
+						bus.write(0x2000, random(256) & 0x3B);
+						break;
+					case 3:     // Rendering off, left column masks, emphasis, grayscale
+						bus.write(0x2001, random(4) == 0 ? random(256) & 0xE7 : 0x18 | (random(256) & 0xE7));
+						break;
+					case 4:     // Nametable and palette writes mid-frame
+						bus.write(0x2006, random(2) ? 0x3F : 0x20 + random(16));
+						bus.write(0x2006, random(256));
+						bus.write(0x2007, random(256));
+						bus.write(0x2007, random(256));
+						break;
+					case 5:     // PPUDATA read
+						bus.read(0x2007);
+						break;
+					case 6:     // OAM through $2004
+						bus.write(0x2003, random(256));
+						bus.write(0x2004, random(256));
+						break;
+					case 7: {   // OAM DMA from RAM
+						uint8_t page = 0x03 + random(4);
+						for (int i = 0; i < 256; i++) {
+							bus.write(page * 0x100 + i, random(256));
+						}
+						bus.write(0x4014, page);
+						break;
+					}
+					case 8:     // Mapper switching mirroring
+						bus.ppu.setMirroring(static_cast<NESROM::Mirroring>(random(5)));
+						break;
+					case 9:     // CHR bank switch
+						bus.ppu.writePatternTable(random(0x2000), random(256));
+						break;
+					default:
+						break;
+				}
+			}
+		}
+
+		uint32_t ticks = 20011 + chunk * 7;
+		deferred.bus.runUntil(deferred.bus.clockCounter + ticks);
+		direct.bus.runUntil(direct.bus.clockCounter + ticks);
+
+		assert(deferred.bus.ppu.status.reg == direct.bus.ppu.status.reg);
+		assert(deferred.bus.ppu.v.vram_register == direct.bus.ppu.v.vram_register);
+		assert(deferred.bus.cpuRam == direct.bus.cpuRam);
+		assert(deferred.cpu.PC == direct.cpu.PC);
+		assert(deferred.bus.ppu.total_frames == direct.bus.ppu.total_frames);
+		const uint16_t* a = deferred.getPixels();
+		const uint16_t* b = direct.getPixels();
+		assert(std::memcmp(a, b, 256 * 240 * sizeof(uint16_t)) == 0);
+	}
+	assert(deferred.bus.ppu.frameDeferred && deferred.bus.ppu.deferredRenderer->threads() == 3);
+	// Something got drawn
+	const uint16_t* frame = direct.getPixels();
+	assert(std::count(frame, frame + 256 * 240, frame[0]) != 256 * 240);
+
+	std::cout << "---------------------------\nDeferred renderer tests passed!\n";
+}
+
+void Tests::test_triple_buffer() {
+	const int pixels = TripleBuffer::WIDTH * TripleBuffer::HEIGHT;
+	auto buffer = std::make_unique<TripleBuffer>();
+
+	// Nothing published yet
+	const uint16_t* shown = buffer->latest();
+	assert(shown[0] == 0 && shown != buffer->back());
+
+	std::fill(buffer->back(), buffer->back() + pixels, uint16_t(1));
+	buffer->publish();
+	shown = buffer->latest();
+	assert(shown[0] == 1 && shown[pixels - 1] == 1);
+	assert(buffer->latest() == shown);     // Same frame until the next publish
+	assert(buffer->back() != shown);
+
+	// Frames the consumer didn't pick up are dropped, it gets the newest one
+	std::fill(buffer->back(), buffer->back() + pixels, uint16_t(2));
+	buffer->publish();
+	assert(buffer->back() != shown);
+	std::fill(buffer->back(), buffer->back() + pixels, uint16_t(3));
+	buffer->publish();
+	assert(buffer->back() != shown);
+	shown = buffer->latest();
+	assert(shown[0] == 3 && shown != buffer->back());
+
+	// Producer on another thread: every frame seen is complete and frames never go back in time
+	const uint32_t lastFrame = 3000;
+	std::thread producer([&buffer, pixels, lastFrame] {
+		for (uint32_t frame = 4; frame <= lastFrame; frame++) {
+			std::fill(buffer->back(), buffer->back() + pixels, uint16_t(frame));
+			buffer->publish();
+		}
+	});
+	uint32_t seen = 3;
+	while (seen != lastFrame) {
+		shown = buffer->latest();
+		uint32_t frame = shown[0];
+		assert(frame >= seen);
+		assert(std::all_of(shown, shown + pixels, [frame](uint16_t pixel) { return pixel == frame; }));
+		seen = frame;
+	}
+	producer.join();
+
+	std::cout << "---------------------------\nTriple buffer tests passed!\n";
+}
+
+void Tests::test_scheduler() {
+	Scheduler scheduler;
+	Scheduler::Event event;
+	assert(scheduler.empty());
+
+	// Earliest first, whatever the order they were scheduled in
+	scheduler.schedule(Scheduler::VBLANK, 500);
+	scheduler.schedule(Scheduler::FRAME_SEQUENCER, 100);
+	scheduler.schedule(Scheduler::DMA_COMPLETE, 300);
+	assert(scheduler.nextTick() == 100);
+	assert(!scheduler.popDue(99, event));
+	assert(scheduler.popDue(100, event) && event == Scheduler::FRAME_SEQUENCER);
+	assert(!scheduler.pending(Scheduler::FRAME_SEQUENCER));
+
+	// Scheduling again moves an event, cancelling drops it
+	scheduler.schedule(Scheduler::VBLANK, 200);
+	assert(scheduler.nextTick() == 200);
+	scheduler.cancel(Scheduler::VBLANK);
+	assert(scheduler.nextTick() == 300);
+	assert(scheduler.popDue(300, event) && event == Scheduler::DMA_COMPLETE);
+	assert(scheduler.empty());
+
+	// Ticks past the wrap of the master clock still come after the ones before it
+	scheduler.schedule(Scheduler::VBLANK, 5);
+	scheduler.schedule(Scheduler::FRAME_SEQUENCER, UINT32_MAX - 5);
+	assert(scheduler.nextTick() == UINT32_MAX - 5);
+	assert(scheduler.popDue(UINT32_MAX - 5, event) && event == Scheduler::FRAME_SEQUENCER);
+	assert(scheduler.popDue(5, event) && event == Scheduler::VBLANK);
+
+	// Two events on the same tick both come out
+	scheduler.schedule(Scheduler::VBLANK, 42);
+	scheduler.schedule(Scheduler::SPRITE_EVALUATION, 42);
+	assert(scheduler.popDue(42, event));
+	assert(scheduler.popDue(42, event));
+	assert(scheduler.empty());
+
+	std::cout << "---------------------------\nScheduler tests passed!\n";
+}
+
+void Tests::test_memory_map(std::string path) {
+	// Reads through the page table match the full decode wherever reading has no side
+	// effects (everything but the PPU, APU and controller registers)
+	NES nes;
+	nes.load_rom(path.c_str());
+	for (uint32_t address = 0x0000; address <= 0xFFFF; address++) {
+		if (address >= 0x2000 && address < 0x4020) {
+			continue;
+		}
+		assert(nes.bus.read(address) == nes.bus.readReference(address));
+	}
+
+	// Writes land in the same place: RAM mirrors, the writable upper PRG copy, and the
+	// lower copy that ignores writes
+	NES reference;
+	reference.load_rom(path.c_str());
+	const uint16_t addresses[] = {0x0000, 0x07FF, 0x0800, 0x1FFF, 0x8000, 0xC000, 0xC123, 0xFFFF};
+	for (uint16_t address : addresses) {
+		nes.bus.write(address, address ^ 0xA5);
+		reference.bus.writeReference(address, address ^ 0xA5);
+	}
+	assert(nes.bus.cpuRam == reference.bus.cpuRam);
+	uint32_t prgSize = nes.rom.ROMheader.prgRomSize * 16 * 1024;
+	assert(std::memcmp(nes.rom.prgRom, reference.rom.prgRom, prgSize) == 0);
+
+	// Without a cartridge everything past the I/O ports is plain test RAM
+	NES blank;
+	blank.bus.write(0x9000, 0x5A);
+	assert(blank.bus.testFallbackRAM[0x9000] == 0x5A);
+	assert(blank.bus.read(0x9000) == 0x5A);
+
+	std::cout << "---------------------------\nMemory map tests passed!\n";
+}
 
 void Tests::test_NES(std::string path) {
 	NES nes;
@@ -723,6 +1356,450 @@ void Tests::test_PPU_registers() {
 	std::cout << "PPU Register Tests Passed\n";
 }
 
+void Tests::test_pixel_mux() {
+	// Backdrop, background only, sprite only, sprite in front, sprite behind, and sprite
+	// zero over an opaque background
+	uint8_t bg[16] = {0x00, 0x05, 0x00, 0x0E, 0x0E, 0x0E, 0x00, 0x0C, 0x03};
+	uint8_t fg[16] = {0x00, 0x00, 0x32, 0x37, 0x17, 0x77, 0x52, 0x21, 0x4D};
+	uint8_t entries[16];
+	uint16_t hits = muxPixels(bg, fg, entries);
+	assert(entries[0] == 0x00 && entries[1] == 0x05 && entries[2] == 0x12);
+	assert(entries[3] == 0x17 && entries[4] == 0x0E && entries[5] == 0x17);
+	assert(entries[6] == 0x12 && entries[7] == 0x01 && entries[8] == 0x03);
+	assert(hits == ((1 << 5) | (1 << 8)));
+
+	// Every combination agrees with the scalar version
+	uint8_t scalar[16];
+	for (int value = 0; value < 128 * 32; value += 16) {
+		for (int i = 0; i < 16; i++) {
+			fg[i] = (value + i) & 0x7F;
+			bg[i] = (value + i) >> 7;
+		}
+		assert(muxPixels(bg, fg, entries) == muxPixelsScalar(bg, fg, scalar));
+		assert(std::memcmp(entries, scalar, 16) == 0);
+	}
+
+	std::cout << "---------------------------\nPixel mux tests passed!\n";
+}
+
+void Tests::test_pixel_convert() {
+	// Every pixel value, an odd count so the last few take the one at a time path, and
+	// bits above the pixel value that must be ignored
+	const int count = 1027;
+	uint16_t pixels[count];
+	for (int i = 0; i < count; i++) {
+		pixels[i] = (i * 37) & PIXEL_MASK;
+	}
+	pixels[5] = 0xFE16;
+	uint32_t rgba[count];
+	uint32_t expected[count];
+	convertPixels(pixels, rgba, count, PPU::EMPHASIS_PALETTES.data());
+	convertPixelsScalar(pixels, expected, count, PPU::EMPHASIS_PALETTES.data());
+	assert(std::memcmp(rgba, expected, sizeof(rgba)) == 0);
+	for (int i = 0; i < count; i++) {
+		assert(rgba[i] == PPU::EMPHASIS_PALETTES[pixels[i] & PIXEL_MASK]);
+	}
+	assert(rgba[5] == PPU::EMPHASIS_PALETTES[0x16]);
+
+	// The NES converts a frame once, when it's first shown
+	NES nes;
+	nes.bus.ppu.framebuffer[0] = 0x01 << 6 | 0x16;
+	nes.bus.ppu.frames.publish();
+	const uint32_t* frame = nes.getFramebuffer();
+	assert(frame[0] == PPU::EMPHASIS_PALETTES[0x01 << 6 | 0x16]);
+	assert(frame[1] == PPU::EMPHASIS_PALETTES[0x00]);
+	nes.rgbFramebuffer[1] = 0;
+	assert(nes.getFramebuffer()[1] == 0);
+	nes.bus.ppu.frames.publish();
+	assert(nes.getFramebuffer()[1] == PPU::EMPHASIS_PALETTES[0x00]);
+
+	std::cout << "---------------------------\nPixel convert tests passed!\n";
+}
+
+void Tests::test_apu_synthesis() {
+	// Half a second: pulse 1 at t = 253 (440 Hz), 50% duty, constant volume 15, length halted;
+	// a quarter second in it drops an octave and the noise channel starts
+	const uint32_t length = static_cast<uint32_t>(APU::CLOCK_RATE / 2);
+	const uint32_t change = length / 2;
+	auto start = [](APU& apu) {
+		apu.writeRegister(0x4000, 0xBF);
+		apu.writeRegister(0x4002, 0xFD);
+		apu.writeRegister(0x4003, 0x00);
+	};
+	auto later = [](APU& apu) {
+		apu.writeRegister(0x4002, 0xFB);
+		apu.writeRegister(0x4003, 0x01);
+		apu.writeRegister(0x400C, 0x3F);
+		apu.writeRegister(0x400E, 0x05);
+		apu.writeRegister(0x400F, 0x00);
+	};
+
+	// Ending frames every 1/60 s or clocking tick by tick gives the same samples
+	auto framed = std::make_unique<APU>();
+	framed->reset();
+	start(*framed);
+	std::vector<float> framedSamples;
+	for (uint32_t tick = 0; tick < length; ) {
+		uint32_t next = std::min(tick + 89342, length);
+		if (tick < change && change <= next) {
+			framed->runUntil(change);
+			later(*framed);
+		}
+		framed->runUntil(next);
+		tick = next;
+		framed->endFrame();
+		framedSamples.insert(framedSamples.end(), framed->samples.begin(), framed->samples.end());
+		framed->samples.clear();
+	}
+	auto clocked = std::make_unique<APU>();
+	clocked->reset();
+	start(*clocked);
+	while (clocked->clockCounter != length) {
+		clocked->clock();
+		if (clocked->clockCounter == change) {
+			later(*clocked);
+		}
+	}
+	clocked->endFrame();
+	assert(framedSamples == clocked->samples);
+
+	// Half a second of samples at the output rate
+	const int rate = framed->sampleRate;
+	assert(std::abs(static_cast<int>(framedSamples.size()) - rate / 2) <= 1);
+
+	// Count periods by the rising edges, after the high-pass filter has settled
+	auto edges = [&framedSamples](size_t from, size_t to) {
+		int count = 0;
+		bool high = false;
+		for (size_t i = from; i < to; i++) {
+			if (!high && framedSamples[i] > 0.01f) {
+				count++;
+				high = true;
+			} else if (high && framedSamples[i] < -0.01f) {
+				high = false;
+			}
+		}
+		return count;
+	};
+	int tenth = rate / 10;
+	assert(std::abs(edges(tenth, 2 * tenth) - 44) <= 1);         // 1789773 / (16 * 254) Hz
+
+	// No sound, no signal
+	auto silent = std::make_unique<APU>();
+	silent->reset();
+	silent->runUntil(length);
+	silent->endFrame();
+	assert(std::all_of(silent->samples.begin(), silent->samples.end(), [](float sample) { return sample == 0.0f; }));
+
+	std::cout << "---------------------------\nAPU synthesis tests passed!\n";
+}
+
+void Tests::test_audio_ring() {
+	auto ring = std::make_unique<AudioRing>();
+	float in[AudioRing::CAPACITY];
+	float out[AudioRing::CAPACITY];
+	for (size_t i = 0; i < AudioRing::CAPACITY; i++) {
+		in[i] = static_cast<float>(i);
+	}
+
+	assert(ring->write(in, 10) == 10 && ring->fill() == 10);
+	assert(ring->read(out, 4) == 4 && out[3] == 3.0f && ring->fill() == 6);
+	assert(ring->underruns == 0 && ring->overruns == 0);
+
+	// Too many to fit: the rest are dropped, samples wrap around the end in order
+	assert(ring->write(in, AudioRing::CAPACITY) == AudioRing::CAPACITY - 6);
+	assert(ring->overruns == 1 && ring->fill() == AudioRing::CAPACITY);
+	assert(ring->read(out, 6) == 6 && out[0] == 4.0f && out[5] == 9.0f);
+	assert(ring->read(out, AudioRing::CAPACITY) == AudioRing::CAPACITY - 6);
+	assert(out[0] == 0.0f && out[AudioRing::CAPACITY - 7] == static_cast<float>(AudioRing::CAPACITY - 7));
+	assert(ring->underruns == 1 && ring->fill() == 0);
+
+	// Rate control: more samples when the ring runs low, fewer when it runs high
+	assert(ring->rateRatio() == 1.0 + AudioRing::MAX_RATE_DELTA);
+	ring->write(in, AudioRing::TARGET_FILL);
+	assert(ring->rateRatio() == 1.0);
+	ring->write(in, AudioRing::TARGET_FILL / 2);
+	assert(ring->rateRatio() == 1.0 - AudioRing::MAX_RATE_DELTA / 2);
+	ring->write(in, AudioRing::CAPACITY);
+	assert(ring->rateRatio() == 1.0 - AudioRing::MAX_RATE_DELTA);
+	ring->read(out, AudioRing::CAPACITY);
+	assert(ring->overruns == 2);
+
+	// Producer on another thread: every sample arrives once and in order
+	const uint32_t total = 1 << 20;
+	std::thread producer([&ring] {
+		float chunk[300];
+		for (uint32_t next = 0; next < total; ) {
+			uint32_t count = std::min<uint32_t>(300, total - next);
+			for (uint32_t i = 0; i < count; i++) {
+				chunk[i] = static_cast<float>(next + i);
+			}
+			next += ring->write(chunk, std::min<size_t>(count, AudioRing::CAPACITY - ring->fill()));
+		}
+	});
+	for (uint32_t expected = 0; expected < total; ) {
+		size_t got = ring->read(out, 512);
+		for (size_t i = 0; i < got; i++) {
+			assert(out[i] == static_cast<float>(expected++));
+		}
+	}
+	producer.join();
+	assert(ring->overruns == 2);     // It only wrote what had room
+
+	std::cout << "---------------------------\nAudio ring tests passed!\n";
+}
+
+void Tests::test_resampler(std::string path) {
+	// The vector kernels add up exactly like the one tap at a time reference, at every phase
+	// and through frame ends
+	BlipBuffer simd(APU::CLOCK_RATE, APU::SAMPLE_RATE, APU::SAMPLE_RATE / 4);
+	BlipBuffer scalar(APU::CLOCK_RATE, APU::SAMPLE_RATE, APU::SAMPLE_RATE / 4);
+	std::vector<float> simdOut(APU::SAMPLE_RATE / 4);
+	std::vector<float> scalarOut(APU::SAMPLE_RATE / 4);
+	std::srand(3);
+	for (int frame = 0; frame < 20; frame++) {
+		for (uint32_t time = 0; time < 89342; time += 1 + std::rand() % 97) {
+			float delta = (std::rand() % 61 - 30) / 128.0f;
+			simd.addDelta(time, delta);
+			scalar.addDeltaScalar(time, delta);
+		}
+		simd.endFrame(89342);
+		scalar.endFrame(89342);
+		int count = simd.readSamples(simdOut.data(), APU::SAMPLE_RATE / 4);
+		assert(scalar.readSamples(scalarOut.data(), APU::SAMPLE_RATE / 4) == count);
+		assert(std::equal(simdOut.begin(), simdOut.begin() + count, scalarOut.begin()));
+	}
+
+	// Offline export goes through the same resampler: a tone set up through the bus comes
+	// out as a WAV of the frames' length
+	NES nes;
+	nes.load_rom(path.c_str());
+	nes.initNES();
+	nes.bus.write(0x4000, 0xBF);
+	nes.bus.write(0x4002, 0xFD);
+	nes.bus.write(0x4003, 0x00);
+	const char* file = "audio_export.wav";
+	assert(nes.exportAudio(file, 30));
+	std::ifstream wav(file, std::ios::binary);
+	std::vector<char> bytes((std::istreambuf_iterator<char>(wav)), std::istreambuf_iterator<char>());
+	wav.close();
+	std::remove(file);
+	assert(bytes.size() > 44 && std::memcmp(bytes.data(), "RIFF", 4) == 0 && std::memcmp(bytes.data() + 8, "WAVE", 4) == 0);
+	int samples = static_cast<int>(bytes.size() - 44) / 2;
+	int expected = static_cast<int>(30 * 89342 / APU::CLOCK_RATE * nes.bus.apu->sampleRate);
+	assert(std::abs(samples - expected) <= 1);
+	bool sound = false;
+	for (size_t i = 44; i < bytes.size(); i += 2) {
+		sound |= bytes[i] != 0 || bytes[i + 1] != 0;
+	}
+	assert(sound);
+
+	std::cout << "---------------------------\nResampler tests passed!\n";
+}
+
+void Tests::test_apu_mixer() {
+	// The tables follow the DAC: within a few percent of its exact formulas everywhere
+	assert(APU::PULSE_TABLE[0] == 0.0f && APU::TND_TABLE[0] == 0.0f);
+	for (int n = 1; n < 31; n++) {
+		float exact = 95.88f / (8128.0f / n + 100);
+		assert(std::abs(APU::PULSE_TABLE[n] - exact) < exact * 0.01f);
+	}
+	for (int triangle = 0; triangle < 16; triangle++) {
+		for (int noise = 0; noise < 16; noise++) {
+			if (triangle == 0 && noise == 0) {
+				continue;
+			}
+			float exact = 159.79f / (1.0f / (triangle / 8227.0f + noise / 12241.0f) + 100);
+			assert(std::abs(APU::TND_TABLE[3 * triangle + 2 * noise] - exact) < exact * 0.05f);
+		}
+	}
+	// Louder steps add less and less
+	assert(APU::PULSE_TABLE[30] < 2 * APU::PULSE_TABLE[15]);
+	assert(APU::TND_TABLE[90] < 2 * APU::TND_TABLE[45]);
+
+	// The triangle alone swings between its table entries for levels 0 and 15
+	auto apu = std::make_unique<APU>();
+	apu->reset();
+	apu->writeRegister(0x4008, 0xFF);
+	apu->writeRegister(0x400A, 0xFD);
+	apu->writeRegister(0x400B, 0x00);
+	apu->runUntil(static_cast<uint32_t>(APU::CLOCK_RATE / 5));
+	apu->endFrame();
+	auto last = apu->samples.end() - apu->sampleRate / 10;
+	auto [low, high] = std::minmax_element(last, apu->samples.end());
+	float swing = (APU::TND_TABLE[45] - APU::TND_TABLE[0]) * 0.5f;
+	assert(std::abs((*high - *low) - swing) < swing * 0.1f);
+
+	std::cout << "---------------------------\nAPU mixer tests passed!\n";
+}
+
+void Tests::test_tile_cache() {
+	PPU ppu;
+	for (int i = 0; i < 0x2000; i++) {
+		ppu.writePatternTable(i, i * 7);
+	}
+	// Tile $13 of the second table, row 5: planes at $1135 and $113D
+	const PPU::TileRow& row = ppu.tileRow(0x1135);
+	assert(row.lo == uint8_t(0x1135 * 7) && row.hi == uint8_t(0x113D * 7));
+	assert(row.pixels == PPU::decodeRow(row.lo, row.hi));
+	assert(PPU::decodeRow(0xC1, 0x81) == 0x0300000000000103ull);
+	for (int i = 0; i < 8; i++) {
+		assert(((row.flippedPixels >> (i * 8)) & 0xFF) == ((row.pixels >> ((7 - i) * 8)) & 0xFF));
+		assert(((row.flippedLo >> i) & 1) == ((row.lo >> (7 - i)) & 1));
+	}
+
+	// CHR-RAM writes through PPUDATA show up on the next fetch
+	ppu.cpuWrite(0x0006, 0x11);
+	ppu.cpuWrite(0x0006, 0x3D);
+	ppu.cpuWrite(0x0007, 0x80);
+	assert(ppu.tileRow(0x1135).hi == 0x80);
+	assert(ppu.tileRow(0x1135).pixels == PPU::decodeRow(uint8_t(0x1135 * 7), 0x80));
+	assert(ppu.tileRow(0x1135).flippedHi == 0x01);
+
+	// Swapping every tile at once
+	ppu.patternTables.fill(0xFF);
+	ppu.invalidateTiles();
+	assert(ppu.tileRow(0x0000).pixels == 0x0303030303030303ull);
+
+	std::cout << "---------------------------\nTile cache tests passed!\n";
+}
+
+void Tests::test_sprite_buckets() {
+	PPU ppu;
+	// Sprites bunched up near the top and bottom so some lines have more than 8
+	for (int i = 0; i < 256; i++) {
+		ppu.writeOAM(i, (i % 4 == 0) ? (i * 13) % 40 + (i > 128 ? 200 : 0) : i * 5);
+	}
+	for (int size = 0; size < 2; size++) {
+		ppu.cpuWrite(0x0000, size ? 0x20 : 0x00);
+		int height = size ? 16 : 8;
+		for (int line = 0; line < 261; line++) {
+			// The sprites a scan of OAM finds, in OAM order
+			uint8_t expected[64];
+			int inRange = 0;
+			for (int i = 0; i < 64; i++) {
+				int diff = line - ppu.OAM[i].y;
+				if (diff >= 0 && diff < height) {
+					expected[inRange++] = i;
+				}
+			}
+
+			ppu.scanline = line;
+			ppu.status.sprite_overflow = 0;
+			ppu.evaluateSprites();
+			assert(ppu.numOfSprites == std::min(inRange, 8));
+			for (int i = 0; i < ppu.numOfSprites; i++) {
+				assert(std::memcmp(&ppu.spriteScanline[i], &ppu.OAM[expected[i]], 4) == 0);
+			}
+			for (int i = ppu.numOfSprites; i < 8; i++) {
+				assert(ppu.spriteScanline[i].y == 0xFF && ppu.spriteScanline[i].x == 0xFF);
+			}
+			assert(ppu.bSpriteZeroHitPossible == (inRange > 0 && expected[0] == 0));
+			assert(ppu.status.sprite_overflow == (inRange > 8));
+		}
+	}
+
+	// OAMDATA writes move sprites on the next evaluation
+	ppu.cpuWrite(0x0000, 0x00);
+	ppu.scanline = 100;
+	ppu.evaluateSprites();
+	uint8_t before = ppu.numOfSprites;
+	ppu.cpuWrite(0x0003, 0x00);
+	ppu.cpuWrite(0x0004, 97);
+	ppu.evaluateSprites();
+	assert(ppu.bSpriteZeroHitPossible && ppu.numOfSprites == std::min(before + 1, 8));
+
+	std::cout << "---------------------------\nSprite bucket tests passed!\n";
+}
+
+void Tests::test_palette() {
+	PPU ppu;
+	// Write color $16 to background palette 1 entry 2 and $21 to the backdrop through
+	// sprite palette 0's mirror
+	ppu.cpuWrite(0x0006, 0x3F);
+	ppu.cpuWrite(0x0006, 0x06);
+	ppu.cpuWrite(0x0007, 0x16);
+	ppu.cpuWrite(0x0006, 0x3F);
+	ppu.cpuWrite(0x0006, 0x10);
+	ppu.cpuWrite(0x0007, 0x21);
+	assert(ppu.paletteColor(0x06) == 0x16);
+	assert(ppu.paletteColor(0x00) == 0x21);
+	assert(ppu.paletteColor(0x10) == 0x21);
+	assert(PPU::EMPHASIS_PALETTES[ppu.paletteColor(0x06)] == ppu.getColor(0x16));
+
+	// Grayscale keeps the brightness column only
+	ppu.cpuWrite(0x0001, 0x01);
+	assert(ppu.paletteColor(0x06) == 0x10);
+	assert(ppu.paletteColor(0x00) == 0x20);
+
+	// Emphasis goes above the color index. Emphasizing red darkens green and blue,
+	// emphasizing all three darkens nothing
+	ppu.cpuWrite(0x0001, 0x20);
+	assert(ppu.paletteColor(0x06) == (0x01 << 6 | 0x16));
+	uint32_t plain = ppu.getColor(0x16);
+	uint32_t red = PPU::EMPHASIS_PALETTES[ppu.paletteColor(0x06)];
+	assert((red & 0xFF) == (plain & 0xFF));
+	assert(((red >> 8) & 0xFF) == ((plain >> 8) & 0xFF) * 3 / 4);
+	assert(((red >> 16) & 0xFF) == ((plain >> 16) & 0xFF) * 3 / 4);
+	assert((red >> 24) == 0xFF);
+	ppu.cpuWrite(0x0001, 0xE0);
+	assert(ppu.paletteColor(0x06) == (0x07 << 6 | 0x16));
+	assert(PPU::EMPHASIS_PALETTES[ppu.paletteColor(0x06)] == plain);
+	ppu.cpuWrite(0x0001, 0x00);
+	assert(ppu.paletteColor(0x06) == 0x16);
+
+	std::cout << "---------------------------\nPalette tests passed!\n";
+}
+
+void Tests::test_nametable_mirroring(std::string path) {
+	// Which 1 KB of VRAM each of $2000, $2400, $2800 and $2C00 lands in
+	const NESROM::Mirroring modes[5] = {NESROM::HORIZONTAL, NESROM::VERTICAL,
+		NESROM::SINGLE_SCREEN_LOW, NESROM::SINGLE_SCREEN_HIGH, NESROM::FOUR_SCREEN};
+	const int expected[5][4] = {{0, 0, 1, 1}, {0, 1, 0, 1}, {0, 0, 0, 0}, {1, 1, 1, 1}, {0, 1, 2, 3}};
+	for (int mode = 0; mode < 5; mode++) {
+		PPU ppu;
+		ppu.setMirroring(modes[mode]);
+		for (int table = 0; table < 4; table++) {
+			uint16_t addr = 0x2000 + table * 0x0400 + 0x0123;
+			ppu.writePPU(addr, 0x10 + table);
+			assert(ppu.nameTables[expected[mode][table] * 0x0400 + 0x0123] == 0x10 + table);
+		}
+		for (int table = 0; table < 4; table++) {
+			uint16_t addr = 0x2000 + table * 0x0400 + 0x0123;
+			// The last write to the same 1 KB wins, $3000-$3EFF mirrors $2000-$2EFF
+			int last = 3;
+			while (expected[mode][last] != expected[mode][table]) {
+				last--;
+			}
+			assert(ppu.readPPU(addr) == 0x10 + last);
+			assert(ppu.readPPU(addr + 0x1000) == 0x10 + last);
+		}
+	}
+
+	// Switching at runtime remaps without moving anything
+	PPU ppu;
+	ppu.setMirroring(NESROM::VERTICAL);
+	ppu.writePPU(0x2400, 0x55);
+	ppu.setMirroring(NESROM::SINGLE_SCREEN_HIGH);
+	assert(ppu.readPPU(0x2000) == 0x55 && ppu.readPPU(0x2C00) == 0x55);
+
+	// Through $2006/$2007
+	ppu.setMirroring(NESROM::HORIZONTAL);
+	ppu.cpuWrite(0x0006, 0x2C);
+	ppu.cpuWrite(0x0006, 0x05);
+	ppu.cpuWrite(0x0007, 0x77);
+	assert(ppu.nameTables[0x0405] == 0x77);
+
+	// The cartridge header picks the mirroring
+	NES nes;
+	nes.load_rom(path.c_str());
+	uint8_t flags6 = nes.rom.ROMheader.flags6;
+	assert(nes.rom.mirroring == ((flags6 & 0x08) ? NESROM::FOUR_SCREEN : (flags6 & 0x01) ? NESROM::VERTICAL : NESROM::HORIZONTAL));
+	assert(nes.bus.ppu.nameTablePages[1] == &nes.bus.ppu.nameTables[(flags6 & 0x01) ? 0x0400 : 0x0000]);
+
+	std::cout << "---------------------------\nNametable mirroring tests passed!\n";
+}
+
 void Tests::test_pattern_tables(std::string path) {
 	NES nes;
 	nes.load_rom(path.c_str()); // current test rom is ./nestest.nes
@@ -8,10 +8,20 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <cstring>
+#include <algorithm>
+#include <memory>
 
 #include "CPU.h"
 #include "NES.h"
 #include "Bus.h"
+#include "Dynarec.h"
+#include "Scheduler.h"
+#include "PixelMux.h"
+#include "TripleBuffer.h"
+#include "PixelConvert.h"
+#include "AudioRing.h"
+#include "BlipBuffer.h"
 
 class Tests {
 public:
@@ -33,9 +43,31 @@ public:
     void test_CPX();
     void test_CPY();
     void test_CLD_SED_CLV();
+    void test_opcode_table();
+    void test_predecode(std::string path);
+    void test_dynarec(std::string path);
+    void test_idle_skip(std::string path);
+    void test_scheduler();
+    void test_run_until(std::string path);
+    void test_dmc(std::string path);
+    void test_memory_map(std::string path);
+    void test_scanline_renderer(std::string path);
+    void test_timing_only(std::string path);
+    void test_deferred_renderer(std::string path);
+    void test_triple_buffer();
     void test_NES(std::string path);
     void test_Bus();
     void test_PPU_registers();
+    void test_palette();
+    void test_nametable_mirroring(std::string path);
+    void test_tile_cache();
+    void test_sprite_buckets();
+    void test_pixel_mux();
+    void test_pixel_convert();
+    void test_apu_synthesis();
+    void test_audio_ring();
+    void test_resampler(std::string path);
+    void test_apu_mixer();
     void test_pattern_tables(std::string path);
     void test_Pulse1();
 };